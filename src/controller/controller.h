@@ -25,6 +25,10 @@ class Controller : private View::CallbackController {
   Controller(View* view, Model* model) : view(view), model(model) {
     this->view->controller = this;
   }
+  ~Controller() {
+    stopping.request_stop();
+    if (plotter.joinable()) plotter.join();
+  }
 
   /*!
     cause sending corresponding message to model (edit/clear expression)
@@ -55,26 +59,78 @@ class Controller : private View::CallbackController {
   }
 
   /*!
-    \return collection of graphs to represent graph expression
+    Cancels plotting in progress without waiting for it, then plots
+    graphs on the thread of the controller driving coroutine of the
+    model, coarse and final graphs are written to the ring of samples
+    as frames. New thread joins the cancelled one before writing, so
+    the ring has the only producer, frame id holds number of the plot
+    in its high half, so samples of cancelled plots are dropped
+  */
+  void plot_graphs(double x_lo, double x_hi, double x_pix, double y_lo,
+                   double y_hi, double y_pix) override {
+    stopping.request_stop();
+    stopping = std::stop_source();
+    std::stop_token stop = stopping.get_token();
+    Generator<Graphs> passes =
+        model->graphs_async(x_lo, x_hi, x_pix, y_lo, y_hi, y_pix, stop);
+    uint64_t number = ++plot;
+    plotter = std::jthread([this, cancelled = std::move(plotter),
+                            passes = std::move(passes), number,
+                            stop]() mutable {
+      if (cancelled.joinable()) cancelled.join();
+      uint64_t frame = number << 32;
+      try {
+        for (const Graphs& graphs : passes) {
+          if (!ring.write(graphs, frame++, stop)) break;
+        }
+      } catch (...) {
+        // failed plotting clears the plot instead of terminating
+        ring.write(Graphs(), frame, stop);
+      }
+      finished.store(number, std::memory_order_release);
+    });
+  }
+
+  /*!
+    Takes samples written by plotting, at most capacity of the ring at once
+    \param[in] receiver receiver of blocks of samples
+    \return number of blocks taken
   */
-  QVector<QMap<double, double>> graph_content(double x_lo, double x_hi,
-                                              int x_pix, double y_lo,
-                                              double y_hi, int y_pix) override {
-    QVector<QMap<double, double>> result;
-    for (const auto& std_map :
-         model->graphs(x_lo, x_hi, x_pix, y_lo, y_hi, y_pix)) {
-      QMap<double, double> qmap;
-      for (const auto& [key, value] : std_map) {
-        qmap.insert(key, value);
+  int take_samples(const PlotBlock& receiver) override {
+    int taken = 0;
+    for (int popped = 0; popped != SAMPLE_RING_CAPACITY; ++popped) {
+      // block is read in place and converted to data of the plot at once
+      const SampleBlock* block = ring.front();
+      if (!block) break;
+      if (block->frame >> 32 == plot) {
+        QVector<QCPGraphData> data;
+        data.reserve((int)block->size);
+        for (size_t i = 0; i != block->size; ++i)
+          data.append(QCPGraphData(block->x[i], block->y[i]));
+        receiver(block->frame, (int)block->graphs, (int)block->graph, data);
+        ++taken;
       }
-      result.append(qmap);
+      ring.release();
     }
-    return result;
+    return taken;
+  }
+
+  /*!
+    \return true until the thread of the last plotting has written
+    its samples or was cancelled
+  */
+  bool plotting() override {
+    return finished.load(std::memory_order_acquire) != plot;
   }
 
  private:
   View* view;
   Model* model;
+  SampleRing ring;
+  std::stop_source stopping;
+  std::jthread plotter;
+  uint64_t plot = 0;
+  std::atomic<uint64_t> finished = 0;
 };
 
 }  // namespace scn
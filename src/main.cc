@@ -25,8 +25,8 @@ int main(int argc, char* argv[]) {
   QApplication app(argc, argv);
   // Calculating Stack
   scn::CalculatingDblStack stack_simple;
-  // Variable as string
-  std::string variable;
+  // Variable bound natively as double
+  scn::Variable variable;
   // Calculating Stack
   scn::CalculatingStack_with_variable stack_w_X(&stack_simple, &variable);
   // Shunting Yard Algorithm Stack
@@ -38,8 +38,17 @@ int main(int argc, char* argv[]) {
   // Computable Expression With Variable
   scn::ComputStrExpressionWithVariable comp_expression_x(&comp_expression,
                                                          &variable);
+  // Worker threads for graph plotting
+  scn::ThreadPool thread_pool;
+  // Cache of sampled tiles of graphs
+  scn::TileCache tile_cache;
   // ExpressionGraphPlot
-  scn::PlotableExpression graph_plot_expression(&comp_expression_x);
+  // Bounded latency of interactive plotting
+  scn::PlotBudget plot_budget = {
+      0, std::chrono::milliseconds(PLOT_TIME_BUDGET_MS)};
+  scn::PlotableExpression graph_plot_expression(
+      &comp_expression_x, true, &thread_pool, &tile_cache, false,
+      plot_budget);
   // Model
   scn::CalculatorModel model(&comp_expression_x, &graph_plot_expression);
   scn::View view;
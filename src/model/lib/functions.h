@@ -5,9 +5,164 @@
 #ifndef FUNCTIONS_H
 #define FUNCTIONS_H
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <numbers>
 
 namespace scn {
+/*!
+  \brief Enumeration - operation codes of expression tokens
+
+  Lexemes are classified once into operation codes, so the
+  properties and functions of tokens are found by array index
+  instead of string comparison.
+*/
+enum class Opcode : unsigned char {
+  number,
+  variable,
+  left_bracket,
+  right_bracket,
+  unary_plus,
+  unary_minus,
+  sin,
+  cos,
+  tan,
+  asin,
+  acos,
+  atan,
+  ln,
+  log,
+  sqrt,
+  pow,
+  mult,
+  div,
+  mod,
+  plus,
+  minus,
+};
+
+/*!
+  \def Number of operation codes for arrays indexed by Opcode
+*/
+#define OPCODE_COUNT (static_cast<size_t>(Opcode::minus) + 1)
+
+/*!
+  \brief Struct - compact expression token
+
+  Operation code and, for number tokens, index of the value
+  in the pool of constants of the expression.
+*/
+struct Token {
+  Opcode opcode;
+  unsigned index;
+};
+
+/*!
+  \brief Struct - enclosure of values of expression over interval of X
+
+  Every value of expression which is not NaN lies in [lo, hi], bounds
+  may be infinite. Empty range (lo > hi) has no values. Defined is false
+  if expression may be NaN somewhere in the interval.
+  Computed bounds are rounded outwards, so enclosure is rigorous.
+*/
+struct Range {
+  double lo;
+  double hi;
+  bool defined;
+
+  /*!
+    Range of a single value
+    \param[in] value value
+    \return range containing only the value, empty for NaN
+  */
+  static Range point(double value) {
+    if (std::isnan(value)) return {INFINITY, -INFINITY, false};
+    return {value, value, true};
+  }
+
+  /*!
+    Range of values of continuous operation at corners of operand ranges,
+    NaN corner (like 0 * inf) makes the range unbounded
+    \param[in] corners values at corners
+    \param[in] defined false if operation may be NaN
+    \return range between the least and the greatest corner
+  */
+  static Range hull(std::initializer_list<double> corners, bool defined) {
+    Range range = {INFINITY, -INFINITY, defined};
+    for (double corner : corners) {
+      if (std::isnan(corner)) return {-INFINITY, INFINITY, defined};
+      range.lo = std::min(range.lo, corner);
+      range.hi = std::max(range.hi, corner);
+    }
+    return range.outward();
+  }
+
+  /*!
+    Widens bounds by one unit in the last place outwards: bounds
+    computed with rounding to nearest or by libm functions (error
+    below one ulp) still enclose exact values
+    \return widened range
+  */
+  Range outward() const {
+    if (empty()) return *this;
+    return {std::nextafter(lo, -INFINITY), std::nextafter(hi, INFINITY),
+            defined};
+  }
+
+  /*!
+    Checks if range has no values
+    \return true if range is empty
+  */
+  bool empty() const { return lo > hi; }
+
+  /*!
+    Checks if range contains the value
+    \param[in] value value
+    \return true if lo <= value <= hi
+  */
+  bool contains(double value) const { return lo <= value && value <= hi; }
+};
+
+/*!
+  \brief Struct - dual number for forward-mode automatic differentiation
+
+  Value of expression and its derivative by X at the same point.
+*/
+struct Dual {
+  double value;
+  double derivative;
+};
+
+/*!
+  Replaces NaN by the canonical quiet NaN: sign and payload of NaN
+  depend on the instruction or library routine which produced it
+  \param[in] value value
+  \return value or canonical NaN
+*/
+inline double canonical(double value) {
+  return std::isnan(value) ? std::numeric_limits<double>::quiet_NaN()
+                           : value;
+}
+
+/*!
+  Out-of-line library functions with canonical NaN results, shared by
+  the interpreters and native code so both give the same bits
+*/
+namespace libm {
+double sin(double a);
+double cos(double a);
+double tan(double a);
+double asin(double a);
+double acos(double a);
+double atan(double a);
+double log(double a);
+double log10(double a);
+double sqrt(double a);
+double pow(double base, double exponent);
+double fmod(double a, double b);
+}  // namespace libm
+
 /*!
   \brief Interface - abstraction for math function class
 */
@@ -31,7 +186,34 @@ class Function {
     \param[in] operands in form of vector of operand values
     \return result of operation
   */
-  virtual double operator()(const std::vector<double>& operands) const = 0;
+  double operator()(const std::vector<double>& operands) const {
+    return operator()(operands[0], arity() > 1 ? operands[1] : 0);
+  }
+  /*!
+    Overloaded operator() provide mean to perform the operation
+    without operand vector, operands go in the same order as in vector
+    \param[in] a first operand (taken from the top of calculating stack)
+    \param[in] b second operand (ignored by unary functions)
+    \return result of operation
+  */
+  virtual double operator()(double a, double b) const = 0;
+  /*!
+    Interval evaluation: encloses values of the operation over ranges
+    of operands, operands go in the same order as in operator()
+    \param[in] a range of first operand
+    \param[in] b range of second operand (ignored by unary functions)
+    \return range of result
+  */
+  virtual Range range(const Range& a, const Range& b) const = 0;
+  /*!
+    Dual evaluation: value of the operation and its derivative by
+    chain rule, operands go in the same order as in operator()
+    \param[in] a first operand with derivative
+    \param[in] b second operand with derivative (ignored by unary
+    functions)
+    \return result with derivative
+  */
+  virtual Dual dual(const Dual& a, const Dual& b) const = 0;
 };
 
 /*!
@@ -131,156 +313,402 @@ class FunctionMap : public Functions {
   const std::map<std::string, Function*> func_map;
 };
 
+/*!
+  Encloses values of periodic function with period 2 * pi, maximum at
+  peak + 2 * k * pi and minimum at peak + pi + 2 * k * pi, monotone
+  between them
+  \param[in] a range of argument
+  \param[in] peak argument of maximum
+  \param[in] f function
+  \return range of values
+*/
+template <class F>
+Range periodic_range(const Range& a, double peak, F f) {
+  if (a.empty()) return a;
+  bool finite = std::isfinite(a.lo) && std::isfinite(a.hi);
+  if (!finite || a.hi - a.lo >= 2 * std::numbers::pi)
+    return {-1, 1, a.defined && finite};
+  // extremum + k * 2 * pi drifts from the exact extremum with |k|,
+  // so the test is widened by the drift and checks two periods
+  double slack = 8 * std::numeric_limits<double>::epsilon() *
+                 std::max(std::abs(a.lo), std::abs(a.hi));
+  auto reaches = [&a, slack](double extremum) {
+    double k = std::floor((a.lo - extremum) / (2 * std::numbers::pi));
+    for (double j = k; j <= k + 2; ++j) {
+      double x = extremum + j * 2 * std::numbers::pi;
+      if (x >= a.lo - slack && x <= a.hi + slack) return true;
+    }
+    return false;
+  };
+  Range range = Range::hull({f(a.lo), f(a.hi)}, a.defined);
+  range = {std::max(range.lo, -1.0), std::min(range.hi, 1.0), range.defined};
+  if (reaches(peak)) range.hi = 1;
+  if (reaches(peak + std::numbers::pi)) range.lo = -1;
+  return range;
+}
+
+/*!
+  Encloses values of monotone function defined on [lo, hi],
+  argument outside of the domain gives NaN
+  \param[in] a range of argument
+  \param[in] lo lower bound of the domain
+  \param[in] hi upper bound of the domain
+  \param[in] f function
+  \param[in] increasing true if function is increasing
+  \return range of values
+*/
+template <class F>
+Range monotone_range(const Range& a, double lo, double hi, F f,
+                     bool increasing) {
+  if (a.empty() || a.hi < lo || a.lo > hi)
+    return {INFINITY, -INFINITY, false};
+  bool defined = a.defined && a.lo >= lo && a.hi <= hi;
+  double first = f(std::max(a.lo, lo)), last = f(std::min(a.hi, hi));
+  if (!increasing) std::swap(first, last);
+  return Range{first, last, defined}.outward();
+}
+
 class unary_plus : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return operands[0];
+  double operator()(double a, double) const override {
+    return a;
+  }
+  Range range(const Range& a, const Range&) const override {
+    return a;
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    return a;
   }
 };
 
 class unary_minus : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return -(operands[0]);
+  double operator()(double a, double) const override {
+    return canonical(-(a));
+  }
+  Range range(const Range& a, const Range&) const override {
+    return {-a.hi, -a.lo, a.defined};
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    return {-(a.value), -a.derivative};
   }
 };
 
 class sin : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::sin(operands[0]);
+  double operator()(double a, double) const override {
+    return libm::sin(a);
+  }
+  Range range(const Range& a, const Range&) const override {
+    return periodic_range(a, std::numbers::pi / 2,
+                          [](double x) { return std::sin(x); });
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    return {std::sin(a.value), std::cos(a.value) * a.derivative};
   }
 };
 
 class cos : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::cos(operands[0]);
+  double operator()(double a, double) const override {
+    return libm::cos(a);
+  }
+  Range range(const Range& a, const Range&) const override {
+    return periodic_range(a, 0, [](double x) { return std::cos(x); });
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    return {std::cos(a.value), -std::sin(a.value) * a.derivative};
   }
 };
 
 class tan : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::tan(operands[0]);
+  double operator()(double a, double) const override {
+    return libm::tan(a);
+  }
+  Range range(const Range& a, const Range&) const override {
+    if (a.empty()) return a;
+    // tan increases between poles, so interval shorter than pi / 2
+    // contains a pole if and only if tan decreases from lo to hi,
+    // unlike the position of the pole this holds for large X
+    bool finite = std::isfinite(a.lo) && std::isfinite(a.hi);
+    double lo = std::tan(a.lo), hi = std::tan(a.hi);
+    if (!finite || !(a.hi - a.lo < std::numbers::pi / 2) || hi < lo)
+      return {-INFINITY, INFINITY, a.defined && finite};
+    return Range{lo, hi, a.defined}.outward();
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    double t = std::tan(a.value);
+    return {t, (1 + t * t) * a.derivative};
   }
 };
 
 class asin : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::asin(operands[0]);
+  double operator()(double a, double) const override {
+    return libm::asin(a);
+  }
+  Range range(const Range& a, const Range&) const override {
+    return monotone_range(
+        a, -1, 1, [](double x) { return std::asin(x); }, true);
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    return {std::asin(a.value),
+            a.derivative / std::sqrt(1 - a.value * a.value)};
   }
 };
 
 class acos : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::acos(operands[0]);
+  double operator()(double a, double) const override {
+    return libm::acos(a);
+  }
+  Range range(const Range& a, const Range&) const override {
+    return monotone_range(
+        a, -1, 1, [](double x) { return std::acos(x); }, false);
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    return {std::acos(a.value),
+            -a.derivative / std::sqrt(1 - a.value * a.value)};
   }
 };
 
 class atan : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::atan(operands[0]);
+  double operator()(double a, double) const override {
+    return libm::atan(a);
+  }
+  Range range(const Range& a, const Range&) const override {
+    if (a.empty()) return a;
+    return Range{std::atan(a.lo), std::atan(a.hi), a.defined}.outward();
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    return {std::atan(a.value), a.derivative / (1 + a.value * a.value)};
   }
 };
 
 class ln : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::log(operands[0]);
+  double operator()(double a, double) const override {
+    return libm::log(a);
+  }
+  Range range(const Range& a, const Range&) const override {
+    return monotone_range(
+        a, 0, INFINITY, [](double x) { return std::log(x); }, true);
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    return {std::log(a.value), a.derivative / a.value};
   }
 };
 
 class log : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::log10(operands[0]);
+  double operator()(double a, double) const override {
+    return libm::log10(a);
+  }
+  Range range(const Range& a, const Range&) const override {
+    return monotone_range(
+        a, 0, INFINITY, [](double x) { return std::log10(x); }, true);
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    return {std::log10(a.value),
+            a.derivative / (a.value * std::numbers::ln10)};
   }
 };
 
 class sqrt : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 1; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::sqrt(operands[0]);
+  double operator()(double a, double) const override {
+    return libm::sqrt(a);
+  }
+  Range range(const Range& a, const Range&) const override {
+    return monotone_range(
+        a, 0, INFINITY, [](double x) { return std::sqrt(x); }, true);
+  }
+  Dual dual(const Dual& a, const Dual&) const override {
+    double r = std::sqrt(a.value);
+    return {r, a.derivative / (2 * r)};
   }
 };
 
 class pow : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 2; }
   bool left_associative() const override { return false; }
-  double operator()(const std::vector<double>& operands) const override {
-    return std::pow(operands[1], operands[0]);
+  double operator()(double a, double b) const override {
+    return libm::pow(b, a);
+  }
+  Range range(const Range& a, const Range& b) const override {
+    // base b, exponent a
+    if (a.empty() || b.empty()) return {INFINITY, -INFINITY, false};
+    bool defined = a.defined && b.defined;
+    if (b.lo > 0) {
+      // monotone in base and in exponent, extremes are at corners
+      return Range::hull({std::pow(b.lo, a.lo), std::pow(b.lo, a.hi),
+                          std::pow(b.hi, a.lo), std::pow(b.hi, a.hi)},
+                         defined);
+    }
+    double n = a.lo;
+    if (a.lo != a.hi || n != std::floor(n) || !std::isfinite(n))
+      return {-INFINITY, INFINITY, false};
+    if (n < 0 && b.contains(0)) return {-INFINITY, INFINITY, defined};
+    if (std::fmod(n, 2) != 0) {
+      return Range::hull({std::pow(b.lo, n), std::pow(b.hi, n)}, defined);
+    }
+    // base is not positive, even power depends on distance to zero
+    double near = b.contains(0) ? 0 : -b.hi;
+    double far = std::max(-b.lo, b.hi);
+    return Range::hull({std::pow(near, n), std::pow(far, n)}, defined);
+  }
+  Dual dual(const Dual& a, const Dual& b) const override {
+    // base b, exponent a, terms with zero derivative are skipped
+    // as log of negative base or 0 * inf would give NaN
+    double r = std::pow(b.value, a.value);
+    double derivative = 0;
+    if (b.derivative != 0)
+      derivative += a.value * std::pow(b.value, a.value - 1) * b.derivative;
+    if (a.derivative != 0)
+      derivative += r * std::log(b.value) * a.derivative;
+    return {r, derivative};
   }
 };
 
 class mult : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 2; }
   bool left_associative() const override { return true; }
-  double operator()(const std::vector<double>& operands) const override {
-    return operands[1] * operands[0];
+  double operator()(double a, double b) const override {
+    return canonical(b * a);
+  }
+  Range range(const Range& a, const Range& b) const override {
+    if (a.empty() || b.empty()) return {INFINITY, -INFINITY, false};
+    return Range::hull({b.lo * a.lo, b.lo * a.hi, b.hi * a.lo, b.hi * a.hi},
+                       a.defined && b.defined);
+  }
+  Dual dual(const Dual& a, const Dual& b) const override {
+    return {b.value * a.value,
+            b.derivative * a.value + b.value * a.derivative};
   }
 };
 
 class div : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 2; }
   bool left_associative() const override { return true; }
-  double operator()(const std::vector<double>& operands) const override {
-    return operands[1] / operands[0];
+  double operator()(double a, double b) const override {
+    return canonical(b / a);
+  }
+  Range range(const Range& a, const Range& b) const override {
+    if (a.empty() || b.empty()) return {INFINITY, -INFINITY, false};
+    if (a.contains(0)) {
+      // possible pole, 0 / 0 is NaN
+      return {-INFINITY, INFINITY, a.defined && b.defined && !b.contains(0)};
+    }
+    return Range::hull({b.lo / a.lo, b.lo / a.hi, b.hi / a.lo, b.hi / a.hi},
+                       a.defined && b.defined);
+  }
+  Dual dual(const Dual& a, const Dual& b) const override {
+    double r = b.value / a.value;
+    return {r, (b.derivative - r * a.derivative) / a.value};
   }
 };
 
 class mod : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 2; }
   bool left_associative() const override { return true; }
-  double operator()(const std::vector<double>& operands) const override {
-    return fmod(operands[1], operands[0]);
+  double operator()(double a, double b) const override {
+    return libm::fmod(b, a);
+  }
+  Range range(const Range& a, const Range& b) const override {
+    if (a.empty() || b.empty()) return {INFINITY, -INFINITY, false};
+    // |fmod(b, a)| < |a| and sign follows b, NaN for a = 0 or infinite b
+    bool defined = a.defined && b.defined && !a.contains(0) &&
+                   std::isfinite(b.lo) && std::isfinite(b.hi);
+    double m = std::max(std::abs(a.lo), std::abs(a.hi));
+    return {b.lo < 0 ? -std::min(m, -b.lo) : 0,
+            b.hi > 0 ? std::min(m, b.hi) : 0, defined};
+  }
+  Dual dual(const Dual& a, const Dual& b) const override {
+    return {fmod(b.value, a.value),
+            b.derivative - std::trunc(b.value / a.value) * a.derivative};
   }
 };
 
 class plus : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 2; }
   bool left_associative() const override { return true; }
-  double operator()(const std::vector<double>& operands) const override {
-    return operands[1] + operands[0];
+  double operator()(double a, double b) const override {
+    return canonical(b + a);
+  }
+  Range range(const Range& a, const Range& b) const override {
+    if (a.empty() || b.empty()) return {INFINITY, -INFINITY, false};
+    return Range::hull({b.lo + a.lo, b.hi + a.hi},
+                       a.defined && b.defined &&
+                           !(std::isinf(a.lo) && std::isinf(b.hi)) &&
+                           !(std::isinf(a.hi) && std::isinf(b.lo)));
+  }
+  Dual dual(const Dual& a, const Dual& b) const override {
+    return {b.value + a.value, b.derivative + a.derivative};
   }
 };
 
 class minus : public Function {
  public:
+  using Function::operator();
   int arity() const override { return 2; }
   bool left_associative() const override { return true; }
-  double operator()(const std::vector<double>& operands) const override {
-    return operands[1] - operands[0];
+  double operator()(double a, double b) const override {
+    return canonical(b - a);
+  }
+  Range range(const Range& a, const Range& b) const override {
+    if (a.empty() || b.empty()) return {INFINITY, -INFINITY, false};
+    return Range::hull({b.lo - a.hi, b.hi - a.lo},
+                       a.defined && b.defined &&
+                           !(std::isinf(a.lo) && std::isinf(b.lo)) &&
+                           !(std::isinf(a.hi) && std::isinf(b.hi)));
+  }
+  Dual dual(const Dual& a, const Dual& b) const override {
+    return {b.value - a.value, b.derivative - a.derivative};
   }
 };
 }  // namespace scn
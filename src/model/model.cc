@@ -4,13 +4,340 @@
 */
 #include "model.h"
 
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <queue>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define NATIVE_X86_64
+#endif
+
 namespace scn {
+namespace libm {
+double sin(double a) { return canonical(std::sin(a)); }
+double cos(double a) { return canonical(std::cos(a)); }
+double tan(double a) { return canonical(std::tan(a)); }
+double asin(double a) { return canonical(std::asin(a)); }
+double acos(double a) { return canonical(std::acos(a)); }
+double atan(double a) { return canonical(std::atan(a)); }
+double log(double a) { return canonical(std::log(a)); }
+double log10(double a) { return canonical(std::log10(a)); }
+double sqrt(double a) { return canonical(std::sqrt(a)); }
+double pow(double base, double exponent) {
+  return canonical(std::pow(base, exponent));
+}
+double fmod(double a, double b) { return canonical(std::fmod(a, b)); }
+}  // namespace libm
+
+namespace {
+/*!
+  Converts the whole string to double
+  \param[in] str string representation of number
+  \return converted number
+*/
+double strToDbl(const std::string& str) {
+  double result;
+  size_t read = 0;
+  try {
+    result = std::stod(str, &read);
+  } catch (std::invalid_argument&) {
+    throw std::string("std::stod error: string <" + str +
+                      "> is unconvertable to number");
+  } catch (std::out_of_range&) {
+    throw std::string("std::stod error: string <" + str +
+                      "> is to big for current number type (double)");
+  }
+  if (str.size() != read) {
+    throw std::string("string <" + str + "> is unconvertable to number");
+  }
+  return result;
+}
+
+/*!
+  Checks if node is number with exactly the value (same sign of zero)
+  \param[in] node expression tree node
+  \param[in] value number value
+  \return true if the node is the number
+*/
+bool is_number(const ExpressionNode& node, double value) {
+  return node.opcode == Opcode::number && node.value == value &&
+         std::signbit(node.value) == std::signbit(value);
+}
+
+/*!
+  Emits postfix tokens of the subtree
+  \param[in] nodes expression tree
+  \param[in] index index of subtree root
+  \param[out] code tokens in postfix order
+  \param[out] constants pool of constants
+*/
+void emit_postfix(const std::vector<ExpressionNode>& nodes, size_t index,
+                  std::vector<Token>* code, std::vector<double>* constants) {
+  const ExpressionNode& node = nodes[index];
+  if (node.opcode == Opcode::number) {
+    code->push_back({Opcode::number, (unsigned)constants->size()});
+    constants->push_back(node.value);
+    return;
+  } else if (node.opcode != Opcode::variable) {
+    if (node.opcode >= Opcode::pow)  // binary functions
+      emit_postfix(nodes, node.b, code, constants);
+    emit_postfix(nodes, node.a, code, constants);
+  }
+  code->push_back({node.opcode, 0});
+}
+
+/*!
+  Appends bytes of the value to machine code
+  \param[in] value value to append
+  \param[out] code machine code
+*/
+template <typename T>
+void emit_value(T value, std::vector<unsigned char>* code) {
+  unsigned char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  code->insert(code->end(), bytes, bytes + sizeof(T));
+}
+
+/*!
+  Emits movsd xmm, [rbp - 16 - 8 * slot] (load == true)
+  or movsd [rbp - 16 - 8 * slot], xmm (load == false)
+  \param[in] load direction of the move
+  \param[in] xmm number of xmm register (0 or 1)
+  \param[in] slot index of stack frame slot
+  \param[out] code machine code
+*/
+void emit_slot(bool load, int xmm, size_t slot,
+               std::vector<unsigned char>* code) {
+  code->insert(code->end(), {0xF2, 0x0F, (unsigned char)(load ? 0x10 : 0x11),
+                             (unsigned char)(0x85 | (xmm << 3))});
+  emit_value((int32_t)(-16 - 8 * (int64_t)slot), code);
+}
+
+/*!
+  Emits call of C function by absolute address:
+  mov rax, imm64; call rax
+  \param[in] address address of the function
+  \param[out] code machine code
+*/
+void emit_call(uint64_t address, std::vector<unsigned char>* code) {
+  code->insert(code->end(), {0x48, 0xB8});
+  emit_value(address, code);
+  code->insert(code->end(), {0xFF, 0xD0});
+}
+
+/*!
+  Emits replacement of NaN in xmm0 by the canonical quiet NaN:
+  ucomisd xmm0, xmm0; jnp done; mov rax, imm64; movq xmm0, rax
+  \param[out] code machine code
+*/
+void emit_canonical(std::vector<unsigned char>* code) {
+  code->insert(code->end(), {0x66, 0x0F, 0x2E, 0xC0, 0x7B, 0x0F, 0x48, 0xB8});
+  emit_value(std::numeric_limits<double>::quiet_NaN(), code);
+  code->insert(code->end(), {0x66, 0x48, 0x0F, 0x6E, 0xC0});
+}
+
+using NodeKey = std::tuple<Opcode, uint64_t, size_t, size_t>;
+
+/*!
+  Finds node with the same operation and operands or appends the node
+  \param[in] node node with operands referring to nodes
+  \param[in,out] known indices of nodes by operation and operands
+  \param[in,out] nodes nodes in topological order
+  \return index of the node
+*/
+size_t intern_node(const ExpressionNode& node, std::map<NodeKey, size_t>* known,
+                   std::vector<ExpressionNode>* nodes) {
+  uint64_t bits;
+  std::memcpy(&bits, &node.value, sizeof(bits));
+  auto [it, inserted] =
+      known->try_emplace({node.opcode, bits, node.a, node.b}, nodes->size());
+  if (inserted) nodes->push_back(node);
+  return it->second;
+}
+
+/*!
+  Appends nodes of the program to hash-consed nodes: node with the same
+  operation and the same operands as known node is not created again
+  \param[in] table table of operation codes
+  \param[in] program compiled program
+  \param[in,out] known indices of nodes by operation and operands
+  \param[in,out] nodes nodes in topological order
+  \return index of result node, number 0 for empty program
+*/
+size_t merge_nodes(const OpcodeTable& table, const ExpressionProgram& program,
+                   std::map<NodeKey, size_t>* known,
+                   std::vector<ExpressionNode>* nodes) {
+  std::vector<size_t> stack;
+  for (const auto& token : program.tokens()) {
+    ExpressionNode node = {token.opcode, 0, 0, 0};
+    if (token.opcode == Opcode::number) {
+      node.value = program.pool()[token.index];
+    } else if (token.opcode != Opcode::variable) {
+      node.a = stack.back();
+      stack.pop_back();
+      if (table.arity(token.opcode) == 2) {
+        node.b = stack.back();
+        stack.pop_back();
+      }
+    }
+    stack.push_back(intern_node(node, known, nodes));
+  }
+  if (!stack.empty()) return stack.back();
+  return intern_node({Opcode::number, 0, 0, 0}, known, nodes);
+}
+
+/*!
+  Keeps only nodes reachable from results, in topological order
+  \param[in] table table of operation codes
+  \param[in] nodes nodes in topological order
+  \param[in,out] results indices of result nodes, updated to kept nodes
+  \return kept nodes
+*/
+std::vector<ExpressionNode> live_nodes(const OpcodeTable& table,
+                                       const std::vector<ExpressionNode>& nodes,
+                                       std::vector<size_t>* results) {
+  std::vector<bool> live(nodes.size());
+  for (size_t result : *results) live[result] = true;
+  for (size_t i = live.size(); i-- != 0;) {
+    if (!live[i] || nodes[i].opcode == Opcode::number ||
+        nodes[i].opcode == Opcode::variable)
+      continue;
+    live[nodes[i].a] = true;
+    if (table.arity(nodes[i].opcode) == 2) live[nodes[i].b] = true;
+  }
+  std::vector<ExpressionNode> dag;
+  std::vector<size_t> index(live.size());
+  for (size_t i = 0; i != live.size(); ++i) {
+    if (!live[i]) continue;
+    index[i] = dag.size();
+    dag.push_back(nodes[i]);
+    dag.back().a = index[nodes[i].a];
+    dag.back().b = index[nodes[i].b];
+  }
+  for (size_t& result : *results) result = index[result];
+  return dag;
+}
+
+/*!
+  Evaluates nodes column-wise for a block of values of variable X
+  \param[in] table table of operation codes
+  \param[in] dag nodes in topological order
+  \param[in] xs values of variable X
+  \param[in] size number of values, at most BATCH_SIZE
+  \param[out] columns values of node n in column n of BATCH_SIZE values
+*/
+void evaluate_block(const OpcodeTable& table,
+                    const std::vector<ExpressionNode>& dag, const double* xs,
+                    size_t size, double* columns) {
+  for (size_t n = 0; n != dag.size(); ++n) {
+    const ExpressionNode& node = dag[n];
+    double* r = columns + n * BATCH_SIZE;
+    const double* a = columns + node.a * BATCH_SIZE;
+    const double* b = columns + node.b * BATCH_SIZE;
+    const Function* function = table.function(node.opcode);
+    switch (node.opcode) {
+      case Opcode::number:
+        std::fill_n(r, size, node.value);
+        break;
+      case Opcode::variable:
+        std::copy_n(xs, size, r);
+        break;
+      case Opcode::unary_minus:
+        for (size_t i = 0; i != size; ++i) r[i] = canonical(-a[i]);
+        break;
+      case Opcode::plus:
+        for (size_t i = 0; i != size; ++i) r[i] = canonical(b[i] + a[i]);
+        break;
+      case Opcode::minus:
+        for (size_t i = 0; i != size; ++i) r[i] = canonical(b[i] - a[i]);
+        break;
+      case Opcode::mult:
+        for (size_t i = 0; i != size; ++i) r[i] = canonical(b[i] * a[i]);
+        break;
+      case Opcode::div:
+        for (size_t i = 0; i != size; ++i) r[i] = canonical(b[i] / a[i]);
+        break;
+      default:
+        for (size_t i = 0; i != size; ++i) r[i] = (*function)(a[i], b[i]);
+    }
+  }
+}
+
+/*!
+  Provides no graphs as passes of plotting
+  \return generator of empty graphs
+*/
+Generator<Graphs> no_graphs() { co_yield Graphs(); }
+
+/*!
+  Yields graphs of passes until stop is requested, error of computation
+  ends the passes with empty graphs. Passes run on the thread resuming
+  the generator, other exceptions are rethrown there.
+  \param[in] passes generator of coarse and final graphs
+  \param[in] stop token of cancellation
+  \return generator of coarse and final graphs
+*/
+Generator<Graphs> stream_graphs(Generator<Graphs> passes,
+                                std::stop_token stop) {
+  while (true) {
+    bool failed = false;
+    try {
+      if (!passes.next()) co_return;
+    } catch (const std::string&) {
+      failed = true;
+    }
+    if (stop.stop_requested()) co_return;
+    Graphs graphs = failed ? Graphs() : passes.take();
+    co_yield std::move(graphs);
+    if (failed) co_return;
+  }
+}
+}  // namespace
+
+// class OpcodeTable
+OpcodeTable::OpcodeTable()
+    : opcodes(OPCODE_MAP), functions(), arities(), precedences() {
+  const std::map<std::string, Function*> func_map(FUNCTION_MAP);
+  const std::map<std::string, int> func_precedence(PRECEDENCE_MAP);
+  for (const auto& [key, value] : func_map) {
+    size_t index = static_cast<size_t>(opcodes.at(key));
+    functions[index] = value;
+    arities[index] = value->arity();
+    precedences[index] = func_precedence.at(key);
+  }
+}
+
+OpcodeTable::~OpcodeTable() {
+  for (const auto& function : functions) {
+    delete function;
+  }
+}
+
+const OpcodeTable& OpcodeTable::shared() {
+  static const OpcodeTable table;
+  return table;
+}
+
+/*!
+  Classifies lexeme
+  \param[in] lexeme button or token string
+  \return operation code, Opcode::number for parts of numbers
+*/
+Opcode OpcodeTable::opcode(const std::string& lexeme) const {
+  auto it = opcodes.find(lexeme);
+  return it == opcodes.end() ? Opcode::number : it->second;
+}
+// end of class OpcodeTable
+
 // class ShuntingYardStringStack
 ShuntingYardStringStack::~ShuntingYardStringStack() {
   delete stack;
-  for (const auto& [key, value] : functions) {
-    delete value;
-  }
+  delete opcodes;
 }
 /*!
   Adds operator token to the stack
@@ -18,6 +345,7 @@ ShuntingYardStringStack::~ShuntingYardStringStack() {
 */
 void ShuntingYardStringStack::push(const std::string& token) const {
   stack->push_back(token);
+  opcodes->push_back(table.opcode(token));
 }
 
 /*!
@@ -29,6 +357,7 @@ void ShuntingYardStringStack::pop_multiple(
     const std::vector<std::string> tokens) const {
   for (size_t i = 0; i != tokens.size(); ++i) {
     stack->pop_back();
+    opcodes->pop_back();
   }
 }
 
@@ -40,9 +369,8 @@ void ShuntingYardStringStack::pop_multiple(
 */
 std::vector<std::string> ShuntingYardStringStack::left_bracket() const {
   std::vector<std::string> result;
-  auto it = stack->rbegin();
-  if (it != stack->rend() && *it == "(") {
-    result.push_back(*it);
+  if (!opcodes->empty() && opcodes->back() == Opcode::left_bracket) {
+    result.push_back(stack->back());
   }
   return result;
 }
@@ -56,10 +384,9 @@ std::vector<std::string> ShuntingYardStringStack::left_bracket() const {
 */
 std::vector<std::string> ShuntingYardStringStack::unary_operators() const {
   std::vector<std::string> result;
-  auto it = stack->rbegin();
-  while (it != stack->rend() && *it != "(" && functions.at(*it)->arity() == 1) {
-    result.push_back(*it);
-    ++it;
+  size_t i = opcodes->size();
+  while (i != 0 && table.arity(opcodes->at(i - 1)) == 1) {
+    result.push_back(stack->at(--i));
   }
   return result;
 }
@@ -73,10 +400,9 @@ std::vector<std::string> ShuntingYardStringStack::unary_operators() const {
 */
 std::vector<std::string> ShuntingYardStringStack::not_unary_operators() const {
   std::vector<std::string> result;
-  auto it = stack->rbegin();
-  while (it != stack->rend() && *it != "(" && functions.at(*it)->arity() > 1) {
-    result.push_back(*it);
-    ++it;
+  size_t i = opcodes->size();
+  while (i != 0 && table.arity(opcodes->at(i - 1)) > 1) {
+    result.push_back(stack->at(--i));
   }
   return result;
 }
@@ -93,14 +419,15 @@ std::vector<std::string> ShuntingYardStringStack::not_unary_operators() const {
 std::vector<std::string> ShuntingYardStringStack::hi_preced_operators(
     const std::string& token) const {
   std::vector<std::string> result;
-  int token_preced = func_precedence.at(token);
-  auto it = stack->rbegin();
-  while (it != stack->rend() && *it != "(" && functions.at(*it)->arity() > 1 &&
-         (func_precedence.at(*it) > token_preced ||
-          (func_precedence.at(*it) == token_preced &&
-           functions.at(token)->left_associative()))) {
-    result.push_back(*it);
-    ++it;
+  Opcode token_opcode = table.opcode(token);
+  int token_preced = table.precedence(token_opcode);
+  bool token_left = table.function(token_opcode)->left_associative();
+  size_t i = opcodes->size();
+  while (i != 0 && table.arity(opcodes->at(i - 1)) > 1 &&
+         (table.precedence(opcodes->at(i - 1)) > token_preced ||
+          (table.precedence(opcodes->at(i - 1)) == token_preced &&
+           token_left))) {
+    result.push_back(stack->at(--i));
   }
   return result;
 }
@@ -114,14 +441,15 @@ bool ShuntingYardStringStack::empty() const { return stack->empty(); }
 /*!
   Clears the stack
 */
-void ShuntingYardStringStack::clear() const { stack->clear(); }
+void ShuntingYardStringStack::clear() const {
+  stack->clear();
+  opcodes->clear();
+}
 // end of class ShuntingYardStringStack
 
 PostfixStringExpression::~PostfixStringExpression() {
   delete expression;
-  for (const auto& [key, value] : functions) {
-    delete value;
-  }
+  delete lexemes;
 }
 
 /*!
@@ -130,16 +458,23 @@ PostfixStringExpression::~PostfixStringExpression() {
 */
 void PostfixStringExpression::edit(const std::string& button) const {
   if (button == "<-") {
-    if (!expression->empty()) expression->pop_back();
+    if (!expression->empty()) {
+      expression->pop_back();
+      lexemes->pop_back();
+    }
   } else {
     expression->push_back(button);
+    lexemes->push_back(table.opcode(button));
   }
 }
 
 /*!
   Clears the expression.
 */
-void PostfixStringExpression::clear() const { expression->clear(); }
+void PostfixStringExpression::clear() const {
+  expression->clear();
+  lexemes->clear();
+}
 
 /*!
   Returns the expression as a string.
@@ -165,15 +500,12 @@ std::string PostfixStringExpression::string() const {
 std::vector<std::string> PostfixStringExpression::tokenized() const {
   std::vector<std::string> result;
   for (size_t i = 0; i != expression->size();) {
-    if (functions.contains(expression->at(i)) || expression->at(i) == "(" ||
-        expression->at(i) == ")") {
+    if (!operand(lexemes->at(i))) {
       result.push_back(expression->at(i));
       i++;
     } else {
       std::string string_number;
-      while (i != expression->size() &&
-             !functions.contains(expression->at(i)) &&
-             expression->at(i) != "(" && expression->at(i) != ")") {
+      while (i != expression->size() && operand(lexemes->at(i))) {
         string_number += expression->at(i);
         i++;
       }
@@ -191,13 +523,14 @@ std::vector<std::string> PostfixStringExpression::postfixed() const {
   std::vector<std::string> result;
   stack->clear();
   for (const auto& token : tokenized()) {
-    if (functions.contains(token)) {
+    Opcode opcode = table.opcode(token);
+    if (table.function(opcode)) {
       append_tokens(stack->hi_preced_operators(token), &result);
       stack->pop_multiple(stack->hi_preced_operators(token));
       stack->push(token);
-    } else if (token == "(") {
+    } else if (opcode == Opcode::left_bracket) {
       stack->push(token);
-    } else if (token == ")") {
+    } else if (opcode == Opcode::right_bracket) {
       append_tokens(stack->not_unary_operators(), &result);
       stack->pop_multiple(stack->not_unary_operators());
       if (stack->empty()) throw std::string("missing left parenthesis");
@@ -216,37 +549,50 @@ std::vector<std::string> PostfixStringExpression::postfixed() const {
   return result;
 }
 
+/*!
+  Checks if lexeme is a part of number or variable operand
+  \param[in] opcode operation code of lexeme
+  \return true for operand lexeme
+*/
+bool PostfixStringExpression::operand(Opcode opcode) const {
+  return opcode == Opcode::number || opcode == Opcode::variable;
+}
+
 void PostfixStringExpression::append_tokens(
     std::vector<std::string> src, std::vector<std::string>* dest) const {
   dest->insert(dest->end(), src.begin(), src.end());
 }
 
-CalculatingDblStack::~CalculatingDblStack() {
-  delete stack;
-  for (const auto& [key, value] : functions) {
-    delete value;
-  }
-}
+CalculatingDblStack::~CalculatingDblStack() { delete stack; }
 
 /*!
   Pushes a token (e.g., number or operator) onto the stack.
   \param[in] token input token
 */
 void CalculatingDblStack::push(const std::string& token) const {
-  std::vector<double> operands;
-  if (functions.contains(token)) {
-    for (int i = 0; i != functions.at(token)->arity(); ++i) {
+  Opcode opcode = table.opcode(token);
+  if (table.function(opcode)) {
+    double operands[2] = {0, 0};
+    for (int i = 0; i != table.arity(opcode); ++i) {
       if (stack->empty()) throw std::string("not enough arguments");
-      operands.push_back(stack->back());
+      operands[i] = stack->back();
       stack->pop_back();
     }
-    stack->push_back(functions.at(token)->operator()(operands));
-    operands.clear();
+    stack->push_back(table.function(opcode)->operator()(operands[0],
+                                                        operands[1]));
   } else {
     stack->push_back(strToDbl(token));
   }
 }
 
+/*!
+  Pushes a number onto the stack without string conversion.
+  \param[in] number input number
+*/
+void CalculatingDblStack::push(double number) const {
+  stack->push_back(number);
+}
+
 /*!
   Returns the top value of the stack.
   \return top value as double
@@ -258,231 +604,2153 @@ double CalculatingDblStack::top() const { return stack->back(); }
 */
 void CalculatingDblStack::clear() const { stack->clear(); }
 
-double CalculatingDblStack::strToDbl(const std::string& str) const {
-  double result;
-  size_t read = 0;
-  try {
-    result = std::stod(str, &read);
-  } catch (std::invalid_argument&) {
-    throw std::string("std::stod error: string <" + str +
-                      "> is unconvertable to number");
-  } catch (std::out_of_range&) {
-    throw std::string("std::stod error: string <" + str +
-                      "> is to big for current number type (double)");
-  }
-  if (str.size() != read) {
-    throw std::string("string <" + str + "> is unconvertable to number");
-  }
-  return result;
-}
-
 /*!
-  Edits the expression using the input button.
-  \param[in] button input button as a string
+  Constructor - compiles the program: classifies tokens, converts
+  numbers into pool of constants and checks that every function
+  has enough arguments
+  \param[in] postfix tokens in postfix notation
 */
-void ComputableStringExpression::edit(const std::string& button) const {
-  expression->edit(button);
+ExpressionProgram::ExpressionProgram(const std::vector<std::string>& postfix)
+    : depth(0) {
+  size_t size = 0;
+  code.reserve(postfix.size());
+  for (const auto& token : postfix) {
+    Opcode opcode = table.opcode(token);
+    if (table.function(opcode)) {
+      if (size < (size_t)table.arity(opcode))
+        throw std::string("not enough arguments");
+      code.push_back({opcode, 0});
+      size -= table.arity(opcode) - 1;
+    } else if (opcode == Opcode::variable) {
+      code.push_back({opcode, 0});
+      depth = std::max(depth, ++size);
+    } else {
+      code.push_back({Opcode::number, (unsigned)constants.size()});
+      constants.push_back(strToDbl(token));
+      depth = std::max(depth, ++size);
+    }
+  }
 }
 
 /*!
-  Clears the expression.
+  Constructor - program from already compiled tokens
+  \param[in] code tokens in postfix order
+  \param[in] constants pool of constants referenced by number tokens
 */
-void ComputableStringExpression::clear() const { expression->clear(); }
+ExpressionProgram::ExpressionProgram(std::vector<Token> code,
+                                     std::vector<double> constants)
+    : code(std::move(code)), constants(std::move(constants)), depth(0) {
+  size_t size = 0;
+  for (const auto& token : this->code) {
+    if (table.function(token.opcode)) {
+      if (size < (size_t)table.arity(token.opcode))
+        throw std::string("not enough arguments");
+      size -= table.arity(token.opcode) - 1;
+    } else {
+      depth = std::max(depth, ++size);
+    }
+  }
+}
 
 /*!
-  Returns the expression as a string.
-  \return string representation of the expression
+  Optimization pass: folds subexpressions independent of X into
+  constants and removes operations that never change the operand
+  (unary plus, double negation, x*1, 1*x, x/1, x^1, x-0, x+(-0)).
+  Identities are applied only when they hold for every IEEE value
+  including NaN, Inf and signed zero, so x+0 is not simplified.
+  \param[out] removed number of removed tokens, may be nullptr
+  \return optimized program
 */
-std::string ComputableStringExpression::string() const {
-  return expression->string();
+ExpressionProgram ExpressionProgram::optimized(size_t* removed) const {
+  std::vector<ExpressionNode> nodes;
+  std::vector<size_t> stack;
+  nodes.reserve(code.size());
+  for (const auto& token : code) {
+    ExpressionNode node = {token.opcode, 0, 0, 0};
+    if (token.opcode == Opcode::number) {
+      node.value = constants[token.index];
+    } else if (token.opcode != Opcode::variable) {
+      const Function* function = table.function(token.opcode);
+      node.a = stack.back();
+      stack.pop_back();
+      const ExpressionNode& a = nodes[node.a];
+      if (table.arity(token.opcode) == 1) {
+        if (token.opcode == Opcode::unary_plus) {
+          stack.push_back(node.a);
+          continue;
+        } else if (token.opcode == Opcode::unary_minus &&
+                   a.opcode == Opcode::unary_minus) {
+          stack.push_back(a.a);
+          continue;
+        } else if (a.opcode == Opcode::number) {
+          node = {Opcode::number, (*function)(a.value, 0), 0, 0};
+        }
+      } else {
+        node.b = stack.back();
+        stack.pop_back();
+        const ExpressionNode& b = nodes[node.b];
+        size_t operand = nodes.size();
+        if (a.opcode == Opcode::number && b.opcode == Opcode::number) {
+          node = {Opcode::number, (*function)(a.value, b.value), 0, 0};
+        } else if ((token.opcode == Opcode::mult ||
+                    token.opcode == Opcode::div ||
+                    token.opcode == Opcode::pow) &&
+                   is_number(a, 1)) {
+          operand = node.b;
+        } else if (token.opcode == Opcode::mult && is_number(b, 1)) {
+          operand = node.a;
+        } else if ((token.opcode == Opcode::plus && is_number(a, -0.0)) ||
+                   (token.opcode == Opcode::minus && is_number(a, 0.0))) {
+          operand = node.b;
+        } else if (token.opcode == Opcode::plus && is_number(b, -0.0)) {
+          operand = node.a;
+        }
+        if (operand != nodes.size()) {
+          stack.push_back(operand);
+          continue;
+        }
+      }
+    }
+    stack.push_back(nodes.size());
+    nodes.push_back(node);
+  }
+  std::vector<Token> result_code;
+  std::vector<double> result_constants;
+  if (!stack.empty())
+    emit_postfix(nodes, stack.back(), &result_code, &result_constants);
+  if (removed) *removed = code.size() - result_code.size();
+  return ExpressionProgram(std::move(result_code), std::move(result_constants));
 }
 
 /*!
-  Computes and returns the result of the expression.
+  Computes the expression with variable X bound to the input value.
+  \param[in] x value of variable X
   \return numeric solution
 */
-double ComputableStringExpression::solution() const {
-  double result = 0;
-  calc_stack->clear();
-  for (const auto& token : expression->postfixed()) {
-    calc_stack->push(token);
-    result = calc_stack->top();
+double ExpressionProgram::solution(double x) const {
+  std::vector<double> stack;
+  stack.reserve(depth);
+  for (const auto& token : code) {
+    if (token.opcode == Opcode::number) {
+      stack.push_back(constants[token.index]);
+    } else if (token.opcode == Opcode::variable) {
+      stack.push_back(x);
+    } else if (table.arity(token.opcode) == 1) {
+      stack.back() = table.function(token.opcode)->operator()(stack.back(), 0);
+    } else {
+      double a = stack.back();
+      stack.pop_back();
+      stack.back() = table.function(token.opcode)->operator()(a, stack.back());
+    }
   }
-  return result;
+  return stack.empty() ? 0 : stack.back();
 }
 
 /*!
-  Pushes a token (e.g., number or operator) onto the stack.
-  \param[in] token input token
+  Interval evaluation: encloses values of the expression
+  for every X in [x_lo, x_hi].
+  \param[in] x_lo lower bound of X
+  \param[in] x_hi upper bound of X
+  \return range of values
 */
-void CalculatingStack_with_variable::push(const std::string& token) const {
-  if (token == "X") {
-    stack->push(*X_str_var);
-  } else {
-    stack->push(token);
+Range ExpressionProgram::range(double x_lo, double x_hi) const {
+  std::vector<Range> stack;
+  stack.reserve(depth);
+  for (const auto& token : code) {
+    if (token.opcode == Opcode::number) {
+      stack.push_back(Range::point(constants[token.index]));
+    } else if (token.opcode == Opcode::variable) {
+      stack.push_back({x_lo, x_hi, true});
+    } else if (table.arity(token.opcode) == 1) {
+      stack.back() = table.function(token.opcode)->range(stack.back(), {});
+    } else {
+      Range a = stack.back();
+      stack.pop_back();
+      stack.back() = table.function(token.opcode)->range(a, stack.back());
+    }
   }
+  return stack.empty() ? Range::point(0) : stack.back();
 }
 
 /*!
-  Returns the top value of the stack.
-  \return top value as double
+  Dual evaluation: computes the expression and its derivative by X
+  in one pass, constants have zero derivative and X has derivative 1.
+  \param[in] x value of variable X
+  \return value and derivative
 */
-double CalculatingStack_with_variable::top() const { return stack->top(); }
+Dual ExpressionProgram::dual(double x) const {
+  std::vector<Dual> stack;
+  stack.reserve(depth);
+  for (const auto& token : code) {
+    if (token.opcode == Opcode::number) {
+      stack.push_back({constants[token.index], 0});
+    } else if (token.opcode == Opcode::variable) {
+      stack.push_back({x, 1});
+    } else if (table.arity(token.opcode) == 1) {
+      stack.back() = table.function(token.opcode)->dual(stack.back(), {});
+    } else {
+      Dual a = stack.back();
+      stack.pop_back();
+      stack.back() = table.function(token.opcode)->dual(a, stack.back());
+    }
+  }
+  return stack.empty() ? Dual{0, 0} : stack.back();
+}
 
 /*!
-  Clears the stack.
+  Computes the expression for every value of variable X.
+  \param[in] xs values of variable X
+  \param[out] out solutions, same size as xs
 */
-void CalculatingStack_with_variable::clear() const { stack->clear(); }
+void ExpressionProgram::solutions(std::span<const double> xs,
+                                  std::span<double> out) const {
+  if (xs.size() != out.size())
+    throw std::string("sizes of variable values and solutions differ");
+  std::vector<double> columns(depth * BATCH_SIZE);
+  for (size_t i = 0; i < xs.size(); i += BATCH_SIZE) {
+    block_solutions(xs.data() + i, out.data() + i,
+                    std::min((size_t)BATCH_SIZE, xs.size() - i),
+                    columns.data());
+  }
+}
 
 /*!
-  Edits the expression using the input button.
-  \param[in] button input button as a string
+  Runs the program over one block of variable values, every stack slot
+  is a column of BATCH_SIZE values and every token is a loop over the
+  block, simple arithmetic is done inline without virtual dispatch
+  \param[in] xs values of variable X
+  \param[out] out solutions
+  \param[in] size number of values in the block, up to BATCH_SIZE
+  \param[in] columns memory for depth columns of BATCH_SIZE values
 */
-void ComputStrExpressionWithVariable::edit(const std::string& button) const {
-  comp_expression->edit(button);
+void ExpressionProgram::block_solutions(const double* xs, double* out,
+                                        size_t size, double* columns) const {
+  size_t top = 0;
+  for (const auto& token : code) {
+    double* next = columns + top * BATCH_SIZE;
+    if (token.opcode == Opcode::number) {
+      std::fill_n(next, size, constants[token.index]);
+      ++top;
+      continue;
+    } else if (token.opcode == Opcode::variable) {
+      std::copy_n(xs, size, next);
+      ++top;
+      continue;
+    }
+    const Function* function = table.function(token.opcode);
+    double* a = next - BATCH_SIZE;
+    if (table.arity(token.opcode) == 1) {
+      if (token.opcode == Opcode::unary_minus) {
+        for (size_t i = 0; i != size; ++i) a[i] = canonical(-a[i]);
+      } else if (token.opcode != Opcode::unary_plus) {
+        for (size_t i = 0; i != size; ++i) a[i] = (*function)(a[i], 0);
+      }
+      continue;
+    }
+    double* b = a - BATCH_SIZE;
+    switch (token.opcode) {
+      case Opcode::plus:
+        for (size_t i = 0; i != size; ++i) b[i] = canonical(b[i] + a[i]);
+        break;
+      case Opcode::minus:
+        for (size_t i = 0; i != size; ++i) b[i] = canonical(b[i] - a[i]);
+        break;
+      case Opcode::mult:
+        for (size_t i = 0; i != size; ++i) b[i] = canonical(b[i] * a[i]);
+        break;
+      case Opcode::div:
+        for (size_t i = 0; i != size; ++i) b[i] = canonical(b[i] / a[i]);
+        break;
+      default:
+        for (size_t i = 0; i != size; ++i) b[i] = (*function)(a[i], b[i]);
+    }
+    --top;
+  }
+  if (top == 0) {
+    std::fill_n(out, size, 0);
+  } else {
+    std::copy_n(columns + (top - 1) * BATCH_SIZE, size, out);
+  }
 }
 
 /*!
-  Clears the expression.
+  Constructor - builds the DAG: merges nodes with the same operation
+  and operands, then drops nodes unreachable from the result
+  \param[in] program compiled program
 */
-void ComputStrExpressionWithVariable::clear() const {
-  comp_expression->clear();
+ExpressionDag::ExpressionDag(const ExpressionProgram& program) {
+  if (program.tokens().empty()) return;
+  std::map<NodeKey, size_t> known;
+  std::vector<ExpressionNode> nodes;
+  std::vector<size_t> results = {merge_nodes(table, program, &known, &nodes)};
+  dag = live_nodes(table, nodes, &results);
 }
 
 /*!
-  Returns the expression as a string.
-  \return string representation of the expression
+  Provides canonical signature of the DAG: operation code, bits of value
+  and operands of every node
+  \return bytes of nodes, equal if and only if DAGs are equal
 */
-std::string ComputStrExpressionWithVariable::string() const {
-  return comp_expression->string();
+std::string ExpressionDag::signature() const {
+  std::string signature;
+  signature.reserve(dag.size() * (1 + 3 * sizeof(uint64_t)));
+  auto append = [&signature](uint64_t word) {
+    signature.append(reinterpret_cast<const char*>(&word), sizeof(word));
+  };
+  for (const auto& node : dag) {
+    uint64_t bits;
+    std::memcpy(&bits, &node.value, sizeof(bits));
+    signature.push_back((char)node.opcode);
+    append(bits);
+    append(node.a);
+    append(node.b);
+  }
+  return signature;
 }
 
 /*!
-  Computes and returns the result of the expression.
+  Computes the expression with variable X bound to the input value,
+  every node is computed once.
+  \param[in] x value of variable X
   \return numeric solution
 */
-double ComputStrExpressionWithVariable::solution() const {
-  return comp_expression->solution();
+double ExpressionDag::solution(double x) const {
+  if (dag.empty()) return 0;
+  std::vector<double> values(dag.size());
+  for (size_t i = 0; i != dag.size(); ++i) {
+    const ExpressionNode& node = dag[i];
+    if (node.opcode == Opcode::number) {
+      values[i] = node.value;
+    } else if (node.opcode == Opcode::variable) {
+      values[i] = x;
+    } else {
+      values[i] =
+          table.function(node.opcode)->operator()(values[node.a],
+                                                  values[node.b]);
+    }
+  }
+  return values.back();
 }
 
 /*!
-  Updates the internal variable value.
-  \param[in] var_value value as a string
+  Interval evaluation: encloses values of the expression
+  for every X in [x_lo, x_hi], every node is evaluated once.
+  \param[in] x_lo lower bound of X
+  \param[in] x_hi upper bound of X
+  \return range of values
 */
-void ComputStrExpressionWithVariable::edit_variable(
-    const std::string& var_value) const {
-  *X_str_var = var_value;
-}
-
-/*!
-  Generates graphs over a defined x/y region and pixel space.
-  \return vector of graph maps (x->y points)
-*/
-std::vector<std::map<double, double>> PlotableExpression::graphs(
-    double x_lo, double x_hi, int x_pix, double y_lo, double y_hi,
-    int y_pix) const {
-  std::map<double, double> graph;
-  double prev_x, y, prev_y;
-  double delta_x = 1.0 / x_pix;
-  double delta_y = 1.0 / y_pix;
-  for (double x = x_lo; x <= x_hi; x += delta_x) {
-    expression_with_var->edit_variable(precise_dblToStr(x));
-    y = expression_with_var->solution();
-    graph[x] = y;
-    if (x != x_lo && std::abs(y - prev_y) > delta_y) {
-      graph.merge(recursive_plot(prev_x, x, delta_y, prev_y, y, y_lo, y_hi));
-    }
-    prev_x = x;
-    prev_y = y;
-  }
-  return cut_subgraphs(graph, y_lo, y_hi);
-}
-
-std::map<double, double> PlotableExpression::recursive_plot(
-    double x_min, double x_max, double delta_y, double y_min, double y_max,
-    double y_lo, double y_hi) const {
-  std::map<double, double> result;
-  double x_mid = (x_min + x_max) / 2;
-  expression_with_var->edit_variable(precise_dblToStr(x_mid));
-  double y_mid = expression_with_var->solution();
-  result[x_mid] = y_mid;
-  if (std::abs(y_mid - y_min) < delta_y || (y_min < y_mid && y_min > y_hi) ||
-      (y_max < y_mid && y_max > y_hi) || (y_max > y_mid && y_max < y_lo) ||
-      (y_min > y_mid && y_min < y_lo)) {
-    return result;
-  } else {
-    result.merge(
-        recursive_plot(x_min, x_mid, delta_y, y_min, y_mid, y_lo, y_hi));
-    result.merge(
-        recursive_plot(x_mid, x_max, delta_y, y_mid, y_max, y_lo, y_hi));
-    return result;
+Range ExpressionDag::range(double x_lo, double x_hi) const {
+  if (dag.empty()) return Range::point(0);
+  std::vector<Range> values(dag.size());
+  for (size_t i = 0; i != dag.size(); ++i) {
+    const ExpressionNode& node = dag[i];
+    if (node.opcode == Opcode::number) {
+      values[i] = Range::point(node.value);
+    } else if (node.opcode == Opcode::variable) {
+      values[i] = {x_lo, x_hi, true};
+    } else {
+      values[i] = table.function(node.opcode)->range(values[node.a],
+                                                     values[node.b]);
+    }
   }
+  return values.back();
 }
 
-std::vector<std::map<double, double>> PlotableExpression::cut_subgraphs(
-    std::map<double, double>& source_graph, double y_lo, double y_hi) const {
-  std::vector<std::map<double, double>> graphs;
-  std::map<double, double> temp_graph;
-  for (const auto& [key, value] : source_graph) {
-    if (value >= y_lo && value <= y_hi) {
-      temp_graph[key] = value;
+/*!
+  Dual evaluation: computes the expression and its derivative by X
+  in one pass, every node is evaluated once.
+  \param[in] x value of variable X
+  \return value and derivative
+*/
+Dual ExpressionDag::dual(double x) const {
+  if (dag.empty()) return {0, 0};
+  std::vector<Dual> values(dag.size());
+  for (size_t i = 0; i != dag.size(); ++i) {
+    const ExpressionNode& node = dag[i];
+    if (node.opcode == Opcode::number) {
+      values[i] = {node.value, 0};
+    } else if (node.opcode == Opcode::variable) {
+      values[i] = {x, 1};
     } else {
-      if (!temp_graph.empty()) {
-        graphs.push_back(temp_graph);
-        temp_graph.clear();
-      }
+      values[i] = table.function(node.opcode)->dual(values[node.a],
+                                                    values[node.b]);
     }
   }
-  if (!temp_graph.empty()) graphs.push_back(temp_graph);
-  return graphs;
+  return values.back();
 }
 
-std::string PlotableExpression::precise_dblToStr(double num) const {
-  char buffer[BUF_SIZE];
-  int written = std::snprintf(buffer, sizeof(buffer), "%a", num);
-  if (written < 0) {
-    throw std::string("Error during convertion double to char buffer");
-  } else if (written >= (int)sizeof(buffer)) {
-    throw std::string("Char buffer is too small for converted double");
+/*!
+  Computes the expression for every value of variable X.
+  \param[in] xs values of variable X
+  \param[out] out solutions, same size as xs
+*/
+void ExpressionDag::solutions(std::span<const double> xs,
+                              std::span<double> out) const {
+  if (xs.size() != out.size())
+    throw std::string("sizes of variable values and solutions differ");
+  std::vector<double> columns(dag.size() * BATCH_SIZE);
+  for (size_t i = 0; i < xs.size(); i += BATCH_SIZE) {
+    block_solutions(xs.data() + i, out.data() + i,
+                    std::min((size_t)BATCH_SIZE, xs.size() - i),
+                    columns.data());
   }
-  return buffer;
 }
 
-CalculatorModel::~CalculatorModel() { delete result; }
+/*!
+  Computes the DAG over one block of variable values, every node
+  is a column of BATCH_SIZE values computed by one loop, simple
+  arithmetic is done inline without virtual dispatch
+  \param[in] xs values of variable X
+  \param[out] out solutions
+  \param[in] size number of values in the block, up to BATCH_SIZE
+  \param[in] columns memory for a column of BATCH_SIZE values per node
+*/
+void ExpressionDag::block_solutions(const double* xs, double* out, size_t size,
+                                    double* columns) const {
+  if (dag.empty()) {
+    std::fill_n(out, size, 0);
+    return;
+  }
+  evaluate_block(table, dag, xs, size, columns);
+  std::copy_n(columns + (dag.size() - 1) * BATCH_SIZE, size, out);
+}
 
 /*!
-  Handles most button presses (except Plot), updates expression and result.
-  Catches and stores error messages on failure.
-  \param[in] button button input string
+  Constructor - builds the DAG: merges nodes with the same operation
+  and operands across all DAGs, then drops nodes unreachable from
+  the results
+  \param[in] dags DAGs of expressions, empty DAG computes 0
 */
-void CalculatorModel::modify(const std::string& button) const {
-  if (button == "AC") {
-    comp_expression_x->clear();
-    result->clear();
-  } else if (button == "=") {
-    try {
-      *result = readble_dblToStr(comp_expression_x->solution());
-    } catch (const std::string& message) {
-      *result = message;
+FusedExpressionDag::FusedExpressionDag(
+    const std::vector<const ExpressionDag*>& dags) {
+  std::map<NodeKey, size_t> known;
+  std::vector<ExpressionNode> nodes;
+  for (const ExpressionDag* expression : dags) {
+    if (expression->nodes().empty()) {
+      results.push_back(intern_node({Opcode::number, 0, 0, 0}, &known, &nodes));
+      continue;
     }
-  } else {
-    comp_expression_x->edit(button);
+    std::vector<size_t> index;
+    for (ExpressionNode node : expression->nodes()) {
+      if (node.opcode != Opcode::number && node.opcode != Opcode::variable) {
+        node.a = index[node.a];
+        if (table.arity(node.opcode) == 2) node.b = index[node.b];
+      }
+      index.push_back(intern_node(node, &known, &nodes));
+    }
+    results.push_back(index.back());
   }
+  dag = live_nodes(table, nodes, &results);
 }
 
 /*!
-  Returns the current expression string.
-  \return string representation of expression
+  Computes every expression for every value of variable X in one pass
+  \param[in] xs values of variable X
+  \param[out] outs solutions of every expression, same size as xs
 */
-std::string CalculatorModel::expression() const {
-  return comp_expression_x->string();
+void FusedExpressionDag::solutions(
+    std::span<const double> xs,
+    const std::vector<std::span<double>>& outs) const {
+  if (outs.size() != results.size())
+    throw std::string("number of solutions and expressions differ");
+  for (const auto& out : outs) {
+    if (xs.size() != out.size())
+      throw std::string("sizes of variable values and solutions differ");
+  }
+  std::vector<double> columns(dag.size() * BATCH_SIZE);
+  for (size_t i = 0; i < xs.size(); i += BATCH_SIZE) {
+    size_t size = std::min((size_t)BATCH_SIZE, xs.size() - i);
+    evaluate_block(table, dag, xs.data() + i, size, columns.data());
+    for (size_t r = 0; r != results.size(); ++r) {
+      std::copy_n(columns.data() + results[r] * BATCH_SIZE, size,
+                  outs[r].data() + i);
+    }
+  }
 }
 
 /*!
-  Returns the current computed result or error message.
-  \return string value of solution
+  Constructor - generates machine code and maps it to executable memory,
+  falls back to interpreter if it is not possible
+  \param[in] dag pointer to expression DAG
 */
-std::string CalculatorModel::some_result() const { return *result; }
+NativeProgram::NativeProgram(const ExpressionDag* const dag)
+    : dag(dag), page(nullptr), page_size(0), entry(nullptr) {
+#ifdef NATIVE_X86_64
+  std::vector<unsigned char> code = generate();
+  page_size = code.size();
+  void* memory = mmap(nullptr, page_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) return;
+  std::memcpy(memory, code.data(), code.size());
+  if (mprotect(memory, page_size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(memory, page_size);
+    return;
+  }
+  page = memory;
+  entry = reinterpret_cast<Entry>(memory);
+#endif
+}
+
+NativeProgram::~NativeProgram() {
+#ifdef NATIVE_X86_64
+  if (page) munmap(page, page_size);
+#endif
+}
+
+/*!
+  Computes the expression with variable X bound to the input value.
+  \param[in] x value of variable X
+  \return numeric solution
+*/
+double NativeProgram::solution(double x) const {
+  if (!entry) return dag->solution(x);
+  return entry(x, constants.data());
+}
+
+/*!
+  Interval evaluation by the DAG, native code is for points only.
+  \param[in] x_lo lower bound of X
+  \param[in] x_hi upper bound of X
+  \return range of values
+*/
+Range NativeProgram::range(double x_lo, double x_hi) const {
+  return dag->range(x_lo, x_hi);
+}
+
+/*!
+  Dual evaluation by the DAG, native code computes values only.
+  \param[in] x value of variable X
+  \return value and derivative
+*/
+Dual NativeProgram::dual(double x) const { return dag->dual(x); }
+
+/*!
+  Computes derivative of the expression with variable X bound
+  to the input value.
+  \param[in] x value of variable X
+  \return derivative
+*/
+double DerivativeProgram::solution(double x) const {
+  return program->dual(x).derivative;
+}
+
+/*!
+  Computes derivative of the expression for every value of variable X.
+  \param[in] xs values of variable X
+  \param[out] out derivatives, same size as xs
+*/
+void DerivativeProgram::solutions(std::span<const double> xs,
+                                  std::span<double> out) const {
+  if (xs.size() != out.size())
+    throw std::string("sizes of variable values and solutions differ");
+  for (size_t i = 0; i != xs.size(); ++i) out[i] = solution(xs[i]);
+}
+
+/*!
+  Interval evaluation of derivative is not supported.
+  \return unbounded range
+*/
+Range DerivativeProgram::range(double, double) const {
+  return {-INFINITY, INFINITY, false};
+}
+
+/*!
+  Dual evaluation of derivative, second derivative is not supported.
+  \param[in] x value of variable X
+  \return derivative and NaN
+*/
+Dual DerivativeProgram::dual(double x) const { return {solution(x), NAN}; }
+
+/*!
+  Computes the expression for every value of variable X.
+  \param[in] xs values of variable X
+  \param[out] out solutions, same size as xs
+*/
+void NativeProgram::solutions(std::span<const double> xs,
+                              std::span<double> out) const {
+  if (!entry) return dag->solutions(xs, out);
+  if (xs.size() != out.size())
+    throw std::string("sizes of variable values and solutions differ");
+  for (size_t i = 0; i != xs.size(); ++i)
+    out[i] = entry(xs[i], constants.data());
+}
+
+/*!
+  Generates System V x86-64 function double(double x, const double* pool).
+  Slot 0 of the stack frame keeps x, slot n + 1 keeps value of node n,
+  rbx keeps pointer to pool of constants across libm calls.
+  Values of number nodes are collected into the pool of constants.
+  NaN results of inline arithmetic are made canonical and library
+  functions are called through the wrappers used by the interpreters.
+  \return machine code
+*/
+std::vector<unsigned char> NativeProgram::generate() {
+  const std::vector<ExpressionNode>& nodes = dag->nodes();
+  // after push rbp and push rbx rsp = 8 (mod 16), calls need 0 (mod 16)
+  int32_t frame = 8 * (nodes.size() + 1);
+  if (frame % 16 == 0) frame += 8;
+  // push rbp; mov rbp, rsp; push rbx; mov rbx, rdi; sub rsp, frame
+  std::vector<unsigned char> code = {0x55, 0x48, 0x89, 0xE5, 0x53, 0x48,
+                                     0x89, 0xFB, 0x48, 0x81, 0xEC};
+  emit_value(frame, &code);
+  emit_slot(false, 0, 0, &code);
+  for (size_t n = 0; n != nodes.size(); ++n) {
+    const ExpressionNode& node = nodes[n];
+    size_t slot = n + 1, a = node.a + 1, b = node.b + 1;
+    switch (node.opcode) {
+      case Opcode::number:
+        // movsd xmm0, [rbx + 8 * index]
+        code.insert(code.end(), {0xF2, 0x0F, 0x10, 0x83});
+        emit_value((int32_t)(8 * constants.size()), &code);
+        constants.push_back(node.value);
+        break;
+      case Opcode::variable:
+        emit_slot(true, 0, 0, &code);
+        break;
+      case Opcode::unary_plus:
+        emit_slot(true, 0, a, &code);
+        break;
+      case Opcode::unary_minus:
+        emit_slot(true, 0, a, &code);
+        // movq rax, xmm0; btc rax, 63; movq xmm0, rax
+        code.insert(code.end(), {0x66, 0x48, 0x0F, 0x7E, 0xC0, 0x48, 0x0F,
+                                 0xBA, 0xF8, 0x3F, 0x66, 0x48, 0x0F, 0x6E,
+                                 0xC0});
+        emit_canonical(&code);
+        break;
+      case Opcode::sqrt:
+        emit_slot(true, 0, a, &code);
+        // sqrtsd xmm0, xmm0
+        code.insert(code.end(), {0xF2, 0x0F, 0x51, 0xC0});
+        emit_canonical(&code);
+        break;
+      case Opcode::plus:
+      case Opcode::minus:
+      case Opcode::mult:
+      case Opcode::div:
+        emit_slot(true, 0, b, &code);
+        emit_slot(true, 1, a, &code);
+        // addsd, subsd, mulsd, divsd xmm0, xmm1
+        code.insert(code.end(),
+                    {0xF2, 0x0F,
+                     (unsigned char)(node.opcode == Opcode::plus    ? 0x58
+                                     : node.opcode == Opcode::minus ? 0x5C
+                                     : node.opcode == Opcode::mult  ? 0x59
+                                                                    : 0x5E),
+                     0xC1});
+        emit_canonical(&code);
+        break;
+      case Opcode::pow:
+      case Opcode::mod:
+        emit_slot(true, 0, b, &code);
+        emit_slot(true, 1, a, &code);
+        emit_call(reinterpret_cast<uint64_t>(node.opcode == Opcode::pow
+                                                 ? libm::pow
+                                                 : libm::fmod),
+                  &code);
+        break;
+      default:
+        double (*function)(double) = nullptr;
+        switch (node.opcode) {
+          case Opcode::sin:
+            function = libm::sin;
+            break;
+          case Opcode::cos:
+            function = libm::cos;
+            break;
+          case Opcode::tan:
+            function = libm::tan;
+            break;
+          case Opcode::asin:
+            function = libm::asin;
+            break;
+          case Opcode::acos:
+            function = libm::acos;
+            break;
+          case Opcode::atan:
+            function = libm::atan;
+            break;
+          case Opcode::ln:
+            function = libm::log;
+            break;
+          default:
+            function = libm::log10;
+        }
+        emit_slot(true, 0, a, &code);
+        emit_call(reinterpret_cast<uint64_t>(function), &code);
+    }
+    emit_slot(false, 0, slot, &code);
+  }
+  if (nodes.empty()) {
+    // xorpd xmm0, xmm0
+    code.insert(code.end(), {0x66, 0x0F, 0x57, 0xC0});
+  } else {
+    emit_slot(true, 0, nodes.size(), &code);
+  }
+  // mov rbx, [rbp - 8]; leave; ret
+  code.insert(code.end(), {0x48, 0x8B, 0x5D, 0xF8, 0xC9, 0xC3});
+  return code;
+}
+
+/*!
+  Edits the expression using the input button.
+  \param[in] button input button as a string
+*/
+void ComputableStringExpression::edit(const std::string& button) const {
+  expression->edit(button);
+}
+
+/*!
+  Clears the expression.
+*/
+void ComputableStringExpression::clear() const { expression->clear(); }
+
+/*!
+  Returns the expression as a string.
+  \return string representation of the expression
+*/
+std::string ComputableStringExpression::string() const {
+  return expression->string();
+}
+
+/*!
+  Computes and returns the result of the expression.
+  \return numeric solution
+*/
+double ComputableStringExpression::solution() const {
+  double result = 0;
+  calc_stack->clear();
+  for (const auto& token : expression->postfixed()) {
+    calc_stack->push(token);
+    result = calc_stack->top();
+  }
+  return result;
+}
+
+/*!
+  Compiles the expression into program for repeated evaluation.
+  \return compiled expression program
+*/
+ExpressionProgram ComputableStringExpression::program() const {
+  return ExpressionProgram(expression->postfixed());
+}
+
+/*!
+  Pushes a token (e.g., number or operator) onto the stack.
+  \param[in] token input token
+*/
+void CalculatingStack_with_variable::push(const std::string& token) const {
+  if (token != "X") {
+    stack->push(token);
+  } else if (X_var) {
+    if (!X_var->error.empty()) throw X_var->error;
+    stack->push(X_var->value);
+  } else {
+    stack->push(*X_str_var);
+  }
+}
+
+/*!
+  Pushes a number onto the stack without string conversion.
+  \param[in] number input number
+*/
+void CalculatingStack_with_variable::push(double number) const {
+  stack->push(number);
+}
+
+/*!
+  Returns the top value of the stack.
+  \return top value as double
+*/
+double CalculatingStack_with_variable::top() const { return stack->top(); }
+
+/*!
+  Clears the stack.
+*/
+void CalculatingStack_with_variable::clear() const { stack->clear(); }
+
+/*!
+  Edits the expression using the input button.
+  \param[in] button input button as a string
+*/
+void ComputStrExpressionWithVariable::edit(const std::string& button) const {
+  comp_expression->edit(button);
+}
+
+/*!
+  Clears the expression.
+*/
+void ComputStrExpressionWithVariable::clear() const {
+  comp_expression->clear();
+}
+
+/*!
+  Returns the expression as a string.
+  \return string representation of the expression
+*/
+std::string ComputStrExpressionWithVariable::string() const {
+  return comp_expression->string();
+}
+
+/*!
+  Computes and returns the result of the expression.
+  \return numeric solution
+*/
+double ComputStrExpressionWithVariable::solution() const {
+  return comp_expression->solution();
+}
+
+/*!
+  Compiles the expression into program for repeated evaluation.
+  \return compiled expression program
+*/
+ExpressionProgram ComputStrExpressionWithVariable::program() const {
+  return comp_expression->program();
+}
+
+/*!
+  Updates the internal variable value.
+  \param[in] var_value value as a string
+*/
+void ComputStrExpressionWithVariable::edit_variable(
+    const std::string& var_value) const {
+  if (X_var) {
+    try {
+      X_var->value = strToDbl(var_value);
+      X_var->error.clear();
+    } catch (const std::string& message) {
+      X_var->error = message;
+    }
+  } else {
+    *X_str_var = var_value;
+  }
+}
+
+/*!
+  Updates the internal variable value without string conversion.
+  Variable bound as string gets the shortest exact representation.
+  \param[in] var_value value as a double
+*/
+void ComputStrExpressionWithVariable::edit_variable(double var_value) const {
+  if (X_var) {
+    X_var->value = var_value;
+    X_var->error.clear();
+  } else {
+    char buffer[BUF_SIZE];
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), var_value);
+    if (ec != std::errc())
+      throw std::string("Char buffer is too small for converted double");
+    X_str_var->assign(buffer, end);
+  }
+}
+
+/*!
+  Computes the expression for every value of variable X,
+  the expression is compiled once for the whole batch.
+  \param[in] xs values of variable X
+  \param[out] out solutions, same size as xs
+*/
+void ComputStrExpressionWithVariable::solutions(std::span<const double> xs,
+                                                std::span<double> out) const {
+  comp_expression->program().solutions(xs, out);
+}
+
+/*!
+  Provides number of samples of the graph
+  \return number of samples
+*/
+size_t GraphView::size() const { return x.size(); }
+
+/*!
+  Finds value of the graph at X by binary search
+  \param[in] key X of sample
+  \return Y of sample
+  \throw std::out_of_range if there is no sample at X
+*/
+double GraphView::at(double key) const {
+  auto it = std::lower_bound(x.begin(), x.end(), key);
+  if (it == x.end() || *it != key) throw std::out_of_range("GraphView::at");
+  return y[it - x.begin()];
+}
+
+/*!
+  Provides number of graphs
+  \return number of graphs
+*/
+size_t Graphs::size() const { return offsets.size() - 1; }
+
+/*!
+  Checks if there is no graph
+  \return true if there is no graph
+*/
+bool Graphs::empty() const { return size() == 0; }
+
+/*!
+  Provides number of samples of all graphs
+  \return number of samples
+*/
+size_t Graphs::samples() const { return offsets.back(); }
+
+/*!
+  Provides number of samples dropped by decimation
+  \return number of dropped samples
+*/
+size_t Graphs::dropped() const { return dropped_samples; }
+
+/*!
+  Checks if refinement ran out of budget before the graphs were exact
+  \return true if graphs are the best approximation so far
+*/
+bool Graphs::truncated() const { return truncated_refinement; }
+
+/*!
+  Marks graphs as truncated by budget of refinement
+*/
+void Graphs::truncate() { truncated_refinement = true; }
+
+/*!
+  Provides statistics of adaptive refinement of the graphs
+  \return samples taken and depth reached by refinement
+*/
+const RefineStats& Graphs::refinement() const { return stats; }
+
+/*!
+  Sets statistics of adaptive refinement of the graphs
+  \param[in] stats samples taken and depth reached by refinement
+*/
+void Graphs::set_refinement(const RefineStats& stats) { this->stats = stats; }
+
+/*!
+  Compares samples of graphs, statistics of refinement are not compared
+  \param[in] other graphs to compare with
+  \return true if graphs have equal samples
+*/
+bool Graphs::operator==(const Graphs& other) const {
+  return xs == other.xs && ys == other.ys && offsets == other.offsets &&
+         dropped_samples == other.dropped_samples &&
+         truncated_refinement == other.truncated_refinement;
+}
+
+/*!
+  Provides view of graph
+  \param[in] graph index of graph
+  \return view of samples of graph
+*/
+GraphView Graphs::operator[](size_t graph) const {
+  size_t begin = offsets[graph], count = offsets[graph + 1] - begin;
+  return {std::span<const double>(xs).subspan(begin, count),
+          std::span<const double>(ys).subspan(begin, count)};
+}
+
+/*!
+  Provides view of the last graph
+  \return view of samples of the last graph
+*/
+GraphView Graphs::back() const { return (*this)[size() - 1]; }
+
+/*!
+  Appends sample to the graph being built
+  \param[in] x X of sample, not less than X of previous sample
+  \param[in] y Y of sample
+*/
+void Graphs::push_back(double x, double y) {
+  xs.push_back(x);
+  ys.push_back(y);
+}
+
+/*!
+  Finishes the graph being built, does nothing if it has no samples
+*/
+void Graphs::split() {
+  if (xs.size() != offsets.back()) offsets.push_back(xs.size());
+}
+
+/*!
+  Reserves memory for samples
+  \param[in] samples expected number of samples
+*/
+void Graphs::reserve(size_t samples) {
+  xs.reserve(samples);
+  ys.reserve(samples);
+}
+
+/*!
+  Decimates graphs by pixel columns [x_lo + k * column,
+  x_lo + (k + 1) * column): keeps first, last, min and max samples
+  of every column of every graph, so the drawn picture stays the same
+  \param[in] x_lo left bound of the screen
+  \param[in] column width of pixel column
+  \return decimated graphs
+*/
+Graphs Graphs::decimated(double x_lo, double column) const {
+  Graphs result;
+  for (size_t graph = 0; graph != size(); ++graph) {
+    size_t i = offsets[graph], end = offsets[graph + 1];
+    while (i != end) {
+      double index = std::floor((xs[i] - x_lo) / column);
+      std::array<size_t, 4> keep = {i, i, i, i};
+      for (++i; i != end && std::floor((xs[i] - x_lo) / column) == index;
+           ++i) {
+        if (ys[i] < ys[keep[1]]) keep[1] = i;
+        if (ys[i] > ys[keep[2]]) keep[2] = i;
+        keep[3] = i;
+      }
+      std::sort(keep.begin(), keep.end());
+      auto last = std::unique(keep.begin(), keep.end());
+      for (auto it = keep.begin(); it != last; ++it)
+        result.push_back(xs[*it], ys[*it]);
+    }
+    result.split();
+  }
+  result.dropped_samples = dropped_samples + samples() - result.samples();
+  result.truncated_refinement = truncated_refinement;
+  result.stats = stats;
+  return result;
+}
+
+/*!
+  Finds tile and marks it as the most recently used
+  \param[in] key key of tile
+  \return tile, nullptr if there is no such tile
+*/
+std::shared_ptr<const TileCache::Tile> TileCache::find(const Key& key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = index.find(key);
+  if (it == index.end()) return nullptr;
+  lru.splice(lru.begin(), lru, it->second);
+  return it->second->second;
+}
+
+/*!
+  Inserts tile as the most recently used one, evicts the least
+  recently used tiles while memory of tiles exceeds capacity
+  \param[in] key key of tile
+  \param[in] tile samples of tile
+*/
+void TileCache::insert(const Key& key, std::shared_ptr<const Tile> tile) {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = index.find(key);
+  if (it != index.end()) {
+    bytes -= footprint(key, *it->second->second);
+    lru.erase(it->second);
+    index.erase(it);
+  }
+  bytes += footprint(key, *tile);
+  lru.emplace_front(key, std::move(tile));
+  index.emplace(key, lru.begin());
+  while (bytes > capacity && !lru.empty()) {
+    bytes -= footprint(lru.back().first, *lru.back().second);
+    index.erase(lru.back().first);
+    lru.pop_back();
+  }
+}
+
+/*!
+  Provides number of cached tiles
+  \return number of tiles
+*/
+size_t TileCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return lru.size();
+}
+
+/*!
+  Provides memory of cached tiles
+  \return memory in bytes
+*/
+size_t TileCache::memory() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return bytes;
+}
+
+/*!
+  Estimates memory of tile with its entry
+  \param[in] key key of tile
+  \param[in] tile samples of tile
+  \return memory in bytes
+*/
+size_t TileCache::footprint(const Key& key, const Tile& tile) {
+  return sizeof(Entry) + key.expression.capacity() + sizeof(Tile) +
+         tile.size() * sizeof(tile[0]);
+}
+
+/*!
+  Hash of key of tile
+  \param[in] key key of tile
+  \return hash
+*/
+size_t TileCache::KeyHash::operator()(const Key& key) const {
+  size_t hash = std::hash<std::string>()(key.expression);
+  for (size_t part :
+       {std::hash<bool>()(key.derivative), std::hash<int64_t>()(key.tile),
+        std::hash<double>()(key.x_pix), std::hash<double>()(key.y_lo),
+        std::hash<double>()(key.y_hi), std::hash<double>()(key.y_pix),
+        std::hash<size_t>()(key.budget.samples),
+        std::hash<int64_t>()(key.budget.time.count()),
+        std::hash<int>()(key.budget.depth)}) {
+    hash ^= part + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+  }
+  return hash;
+}
+
+/*!
+  \brief Struct - shared state of ThreadPool workers
+*/
+struct ThreadPool::State {
+  /*!
+    \brief Struct - deque of tasks of one worker
+  */
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+  std::vector<std::thread> workers;
+  std::vector<Queue> queues;
+  std::mutex call;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::atomic<size_t> queued = 0;
+  std::atomic<size_t> pending = 0;
+  std::exception_ptr error;
+  bool stop = false;
+
+  explicit State(size_t threads) : queues(threads) {}
+};
+
+/*!
+  Constructor - starts worker threads
+  \param[in] threads total number of threads including calling thread
+*/
+ThreadPool::ThreadPool(size_t threads)
+    : state(new State(std::max(threads, (size_t)1))) {
+  for (size_t i = 1; i < threads; ++i) {
+    state->workers.emplace_back([this, i] {
+      std::unique_lock<std::mutex> lock(state->mutex);
+      while (true) {
+        state->wake.wait(lock,
+                         [this] { return state->stop || state->queued != 0; });
+        if (state->stop) return;
+        lock.unlock();
+        work(i);
+        lock.lock();
+      }
+    });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->stop = true;
+  }
+  state->wake.notify_all();
+  for (auto& worker : state->workers) worker.join();
+  delete state;
+}
+
+/*!
+  Runs body for every index, returns when all bodies are finished.
+  First exception thrown by a body is rethrown to the caller.
+  \param[in] count number of jobs
+  \param[in] body job taking index in range [0, count)
+*/
+void ThreadPool::parallel_for(size_t count,
+                              const std::function<void(size_t)>& body) const {
+  std::vector<Task> tasks;
+  tasks.reserve(count);
+  for (size_t i = 0; i != count; ++i) {
+    tasks.push_back([&body, i](size_t) { body(i); });
+  }
+  run(std::move(tasks));
+}
+
+/*!
+  Runs tasks and all subtasks spawned by them, returns when all
+  are finished. First exception thrown by a task is rethrown.
+  \param[in] tasks root tasks
+*/
+void ThreadPool::run(std::vector<Task> tasks) const {
+  std::lock_guard<std::mutex> call(state->call);
+  state->error = nullptr;
+  state->pending += tasks.size();
+  for (size_t i = 0; i != tasks.size(); ++i) {
+    State::Queue& queue = state->queues[i % state->queues.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(tasks[i]));
+    ++state->queued;
+  }
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+  }
+  state->wake.notify_all();
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (state->pending != 0) {
+    lock.unlock();
+    work(0);
+    lock.lock();
+    state->wake.wait(lock, [this] {
+      return state->pending == 0 || state->queued != 0;
+    });
+  }
+  if (state->error) std::rethrow_exception(state->error);
+}
+
+/*!
+  Spawns subtask to the back of worker's deque. Queued tasks are
+  counted after the push under the lock of the deque, so a woken
+  worker always finds the task and the count never runs ahead of it.
+  \param[in] worker index of worker running the calling task
+  \param[in] task subtask
+*/
+void ThreadPool::spawn(size_t worker, Task task) const {
+  ++state->pending;
+  {
+    State::Queue& queue = state->queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+    ++state->queued;
+  }
+  {
+    // waiters check the count under this mutex, no wakeup is lost
+    std::lock_guard<std::mutex> lock(state->mutex);
+  }
+  state->wake.notify_one();
+}
+
+/*!
+  Provides number of threads running jobs
+  \return number of threads, worker indices are in [0, concurrency)
+*/
+size_t ThreadPool::concurrency() const { return state->queues.size(); }
+
+/*!
+  Runs tasks from own deque and stolen from other deques
+  until there is no queued task
+  \param[in] worker index of worker
+*/
+void ThreadPool::work(size_t worker) const {
+  Task task;
+  while (take(worker, &task)) {
+    try {
+      task(worker);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (!state->error) state->error = std::current_exception();
+    }
+    task = nullptr;
+    if (--state->pending == 0) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->wake.notify_all();
+    }
+  }
+}
+
+/*!
+  Takes task from the back of own deque or steals one from the front
+  of deque of another worker
+  \param[in] worker index of worker
+  \param[out] task taken task
+  \return true if task is taken
+*/
+bool ThreadPool::take(size_t worker, Task* task) const {
+  size_t count = state->queues.size();
+  for (size_t i = 0; i != count; ++i) {
+    State::Queue& queue = state->queues[(worker + i) % count];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) continue;
+    if (i == 0) {
+      *task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      *task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    --state->queued;
+    return true;
+  }
+  return false;
+}
+
+/*!
+  Constructor - allocates blocks of the ring
+  \param[in] capacity number of blocks, rounded up to a power of 2
+*/
+SampleRing::SampleRing(size_t capacity)
+    : blocks(std::bit_ceil(std::max(capacity, (size_t)1))),
+      mask(blocks.size() - 1) {}
+
+/*!
+  Puts block into the ring, called by the only producer
+  \param[in] block block of samples
+  \return false if the ring is full
+*/
+bool SampleRing::push(const SampleBlock& block) {
+  SampleBlock* slot = reserve();
+  if (!slot) return false;
+  *slot = block;
+  commit();
+  return true;
+}
+
+/*!
+  Takes the oldest block from the ring, called by the only consumer
+  \param[out] block block of samples
+  \return false if the ring is empty
+*/
+bool SampleRing::pop(SampleBlock* block) {
+  const SampleBlock* slot = front();
+  if (!slot) return false;
+  *block = *slot;
+  release();
+  return true;
+}
+
+/*!
+  Gives the free block to be filled in place, called by the only producer
+  \return block published by commit, nullptr if the ring is full
+*/
+SampleBlock* SampleRing::reserve() {
+  size_t back = tail.load(std::memory_order_relaxed);
+  if (back - head.load(std::memory_order_acquire) == blocks.size())
+    return nullptr;
+  return &blocks[back & mask];
+}
+
+/*!
+  Publishes the block given by reserve, called by the only producer
+*/
+void SampleRing::commit() {
+  tail.store(tail.load(std::memory_order_relaxed) + 1,
+             std::memory_order_release);
+}
+
+/*!
+  Gives the oldest block to be read in place, called by the only consumer
+  \return block freed by release, nullptr if the ring is empty
+*/
+const SampleBlock* SampleRing::front() const {
+  size_t front = head.load(std::memory_order_relaxed);
+  if (front == tail.load(std::memory_order_acquire)) return nullptr;
+  return &blocks[front & mask];
+}
+
+/*!
+  Frees the block given by front, called by the only consumer
+*/
+void SampleRing::release() {
+  head.store(head.load(std::memory_order_relaxed) + 1,
+             std::memory_order_release);
+  wake();
+}
+
+/*!
+  Wakes the writer waiting while the ring is full
+*/
+void SampleRing::wake() {
+  wakes.fetch_add(1, std::memory_order_release);
+  wakes.notify_one();
+}
+
+/*!
+  Writes graphs as a new frame of blocks, called by the only producer,
+  waits while the ring is full
+  \param[in] graphs graphs to write
+  \param[in] frame id of the frame
+  \param[in] stop token of cancellation
+  \return false if stop was requested before all blocks were written
+*/
+bool SampleRing::write(const Graphs& graphs, uint64_t frame,
+                       std::stop_token stop) {
+  // writer sleeps until the reader frees a block or stop is requested,
+  // counter of wakes is read before reserve, so no wake is missed
+  std::stop_callback waking(stop, [this] { wake(); });
+  // samples are copied straight into the free block of the ring
+  auto next = [&](size_t graph) -> SampleBlock* {
+    for (;;) {
+      uint32_t woken = wakes.load(std::memory_order_acquire);
+      if (SampleBlock* block = reserve()) {
+        block->frame = frame;
+        block->graphs = graphs.size();
+        block->graph = graph;
+        block->size = 0;
+        return block;
+      }
+      if (stop.stop_requested()) return nullptr;
+      wakes.wait(woken, std::memory_order_acquire);
+    }
+  };
+  if (graphs.empty()) {
+    if (!next(0)) return false;
+    commit();
+    return true;
+  }
+  for (size_t g = 0; g != graphs.size(); ++g) {
+    GraphView graph = graphs[g];
+    size_t i = 0;
+    do {
+      SampleBlock* block = next(g);
+      if (!block) return false;
+      block->size = std::min((size_t)SAMPLE_BLOCK_SIZE, graph.size() - i);
+      std::copy_n(graph.x.begin() + i, block->size, block->x.begin());
+      std::copy_n(graph.y.begin() + i, block->size, block->y.begin());
+      commit();
+      i += block->size;
+    } while (i != graph.size());
+  }
+  return true;
+}
+
+/*!
+  Generates graphs over a defined x/y region and pixel space.
+  \return graphs, every graph is sorted by X
+*/
+Graphs PlotableExpression::graphs(double x_lo, double x_hi, double x_pix,
+                                  double y_lo, double y_hi,
+                                  double y_pix) const {
+  return plot(x_lo, x_hi, x_pix, y_lo, y_hi, y_pix)(std::stop_token());
+}
+
+/*!
+  Generates graphs of several expressions over the same x/y region and
+  pixel space in one pass over the grid of X.
+  \param[in] expressions pointers to expressions with variable
+  \return graphs of every expression in the same order
+*/
+std::vector<Graphs> PlotableExpression::graphs(
+    const std::vector<const ComputExpressionWithVariable*>& expressions,
+    double x_lo, double x_hi, double x_pix, double y_lo, double y_hi,
+    double y_pix) const {
+  std::vector<Curve> curves;
+  std::vector<const ExpressionDag*> dags;
+  for (const auto* expression : expressions) {
+    curves.push_back(compile(expression->program().optimized()));
+    dags.push_back(curves.back().dag.get());
+  }
+  // derivatives are computed by dual evaluation of every curve
+  std::optional<FusedExpressionDag> fused;
+  if (!derivative && curves.size() > 1) fused.emplace(dags);
+  Generator<Pass> pass =
+      sample(std::move(curves), fused ? &*fused : nullptr, x_lo, x_hi, x_pix,
+             y_lo, y_hi, y_pix, false, std::stop_token());
+  pass.next();
+  return std::move(pass.take().graphs);
+}
+
+/*!
+  Compiles expression on calling thread and prepares job of plotting,
+  the job does not refer to the expression and may run on any thread
+  \param[in] progress receiver of coarse graphs, may be empty
+  \return job generating graphs, empty graphs if stop is requested
+*/
+GraphsJob PlotableExpression::plot(double x_lo, double x_hi, double x_pix,
+                                   double y_lo, double y_hi, double y_pix,
+                                   GraphsSink progress) const {
+  Curve curve = compile(expression_with_var->program().optimized());
+  return [this, curve, x_lo, x_hi, x_pix, y_lo, y_hi, y_pix,
+          progress](std::stop_token stop) {
+    Generator<Pass> pass = sample({curve}, nullptr, x_lo, x_hi, x_pix, y_lo,
+                                  y_hi, y_pix, (bool)progress, stop);
+    while (pass.next() && !pass.value().final) progress(pass.value().graphs[0]);
+    return std::move(pass.take().graphs[0]);
+  };
+}
+
+/*!
+  Compiles expression on calling thread and prepares coroutine of
+  plotting, the coroutine does not refer to the expression and samples
+  on the thread resuming it (and on DI executor)
+  \param[in] stop token of cancellation
+  \return generator of coarse and final graphs, empty final graphs if
+  stop is requested
+*/
+Generator<Graphs> PlotableExpression::plot_async(double x_lo, double x_hi,
+                                                 double x_pix, double y_lo,
+                                                 double y_hi, double y_pix,
+                                                 std::stop_token stop) const {
+  return passes(compile(expression_with_var->program().optimized()), x_lo,
+                x_hi, x_pix, y_lo, y_hi, y_pix, stop);
+}
+
+/*!
+  Yields graphs of the curve after every pass of progressive sampling
+  \param[in] curve compiled curve
+  \param[in] stop token of cancellation
+  \return generator of coarse and final graphs
+*/
+Generator<Graphs> PlotableExpression::passes(Curve curve, double x_lo,
+                                             double x_hi, double x_pix,
+                                             double y_lo, double y_hi,
+                                             double y_pix,
+                                             std::stop_token stop) const {
+  Generator<Pass> pass = sample({curve}, nullptr, x_lo, x_hi, x_pix, y_lo,
+                                y_hi, y_pix, true, stop);
+  while (pass.next()) {
+    Graphs graphs = std::move(pass.take().graphs[0]);
+    co_yield std::move(graphs);
+  }
+}
+
+/*!
+  Compiles optimized program of expression for sampling of its curve
+  \param[in] program optimized program
+  \return compiled curve
+*/
+PlotableExpression::Curve PlotableExpression::compile(
+    const ExpressionProgram& program) const {
+  Curve curve;
+  curve.dag = std::make_shared<const ExpressionDag>(program);
+  curve.function = curve.dag;
+  if (jit)
+    curve.function = std::make_shared<const NativeProgram>(curve.dag.get());
+  curve.program = curve.function;
+  curve.expression = curve.dag->signature();
+  if (derivative) {
+    curve.program =
+        std::make_shared<const DerivativeProgram>(curve.function.get());
+  }
+  return curve;
+}
+
+/*!
+  Samples compiled curves over a defined x/y region and pixel space,
+  takes tiles present in the cache and samples only missing ones.
+  Curves share the grid of X, with fused DAG the grid is evaluated
+  for all curves in one pass. Stops sampling and refinement as soon
+  as stop is requested.
+  Coroutine runs on the thread resuming it, fused DAG must outlive it.
+  \param[in] curves compiled curves
+  \param[in] fused DAG of all curves, nullptr to evaluate every curve
+  by its program
+  \param[in] progressive true to yield coarse graphs of the only curve
+  before the final ones
+  \param[in] stop token of cancellation
+  \return generator of graphs of every curve, the last pass is final,
+  empty graphs if stop is requested
+*/
+Generator<PlotableExpression::Pass> PlotableExpression::sample(
+    std::vector<Curve> curves, const FusedExpressionDag* fused, double x_lo,
+    double x_hi, double x_pix, double y_lo, double y_hi, double y_pix,
+    bool progressive, std::stop_token stop) const {
+  auto start = std::chrono::steady_clock::now();
+  const int64_t tile_size = TILE_SAMPLES;
+  const Pass none = {std::vector<Graphs>(curves.size()), true};
+  if (x_hi < x_lo || !(x_pix > 0) || !(y_pix > 0) || std::isinf(x_pix) ||
+      std::isinf(y_pix)) {
+    co_yield none;
+    co_return;
+  }
+  // resolution of sampling (pixels per unit, fraction when the screen
+  // spans more units than pixels) is rounded up to powers of 2, so grid
+  // has from 1 to 2 points per pixel and its size is bounded by width of
+  // the screen at any zoom; refinement bounds are snapped outward to
+  // a grid of the screen height rounded up to a power of 2, so tiles are
+  // reused while zooming within an octave and panning vertically
+  double grid_x_pix = std::exp2(std::ceil(std::log2(x_pix)));
+  double grid_y_pix = std::exp2(std::ceil(std::log2(y_pix)));
+  double bound_lo = y_lo, bound_hi = y_hi;
+  if (y_lo < y_hi) {
+    double height = std::exp2(std::ceil(std::log2(y_hi - y_lo)));
+    bound_lo = std::floor(y_lo / height) * height;
+    bound_hi = bound_lo + 2 * height;
+  }
+  double delta_x = 1.0 / grid_x_pix;
+  double delta_y = 1.0 / grid_y_pix;
+  // grid X = k * delta_x, tile t holds k in [t * tile_size, t * tile_size
+  // + tile_size) and intervals of refinement starting there; grid points
+  // of the screen are k_lo..k_hi, the first and the last ones lie at or
+  // beyond the ends of the screen, so the graph spans the whole width
+  auto floor_div = [](int64_t a, int64_t b) {
+    return a / b - (a % b != 0 && (a < 0) != (b < 0));
+  };
+  int64_t k_lo = (int64_t)std::floor(x_lo / delta_x);
+  int64_t k_hi = (int64_t)std::ceil(x_hi / delta_x);
+  if (k_hi < k_lo) {
+    co_yield none;
+    co_return;
+  }
+  int64_t t_lo = floor_div(k_lo, tile_size);
+  size_t count = floor_div(k_hi, tile_size) - t_lo + 1;
+  auto key = [&](size_t curve, size_t c) {
+    return TileCache::Key{curves[curve].expression,
+                          derivative,
+                          t_lo + (int64_t)c,
+                          grid_x_pix,
+                          bound_lo,
+                          bound_hi,
+                          grid_y_pix,
+                          budget};
+  };
+  // tile missing for any curve is sampled for all curves
+  using Tiles = std::vector<std::shared_ptr<const TileCache::Tile>>;
+  std::vector<Tiles> curve_tiles(curves.size(), Tiles(count));
+  std::vector<size_t> missing;
+  for (size_t c = 0; c != count; ++c) {
+    bool found = true;
+    for (size_t curve = 0; curve != curves.size(); ++curve) {
+      if (cache) curve_tiles[curve][c] = lookup(key(curve, c), PYRAMID_LEVELS);
+      found = found && curve_tiles[curve][c];
+    }
+    if (!found) missing.push_back(c);
+  }
+  // every missing tile is sampled at tile_size + 1 points of the grid,
+  // including the first point of the next tile
+  size_t points = tile_size + 1;
+  std::vector<double> xs(missing.size() * points);
+  std::vector<std::vector<double>> grid_ys(
+      curves.size(), std::vector<double>(missing.size() * points));
+  // evaluates every curve at the points, fused DAG computes subexpressions
+  // common to curves once
+  auto evaluate = [&](std::span<const double> x,
+                      const std::vector<std::span<double>>& y) {
+    if (fused) {
+      fused->solutions(x, y);
+    } else {
+      for (size_t curve = 0; curve != curves.size(); ++curve)
+        curves[curve].program->solutions(x, y[curve]);
+    }
+  };
+  // values of grid points found in coarser cached tiles (zoom-in) for
+  // every curve are not evaluated again, only the new points between them
+  std::vector<unsigned> found(xs.size());
+  std::vector<unsigned char> seeded(missing.size());
+  if (cache) {
+    parallel_for(missing.size(), [&](size_t m) {
+      if (stop.stop_requested()) return;
+      size_t begin = m * points;
+      int64_t k = (t_lo + (int64_t)missing[m]) * tile_size;
+      for (size_t i = 0; i != points; ++i)
+        xs[begin + i] = (k + (int64_t)i) * delta_x;
+      for (size_t curve = 0; curve != curves.size(); ++curve) {
+        seed(key(curve, missing[m]), std::span(xs).subspan(begin, points),
+             std::span(grid_ys[curve]).subspan(begin, points),
+             std::span(found).subspan(begin, points));
+      }
+      for (size_t i = 0; i != points; ++i)
+        seeded[m] = seeded[m] || found[begin + i] == curves.size();
+    });
+  }
+  // evaluates points of missing tiles with index multiple of stride
+  // except ones already evaluated with index multiple of done
+  auto pass = [&](size_t stride, size_t done) {
+    parallel_for(missing.size(), [&](size_t m) {
+      if (stop.stop_requested()) return;
+      size_t begin = m * points;
+      int64_t k = (t_lo + (int64_t)missing[m]) * tile_size;
+      if (stride == 1 && done == 0 && !seeded[m]) {
+        for (size_t i = 0; i != points; ++i)
+          xs[begin + i] = (k + (int64_t)i) * delta_x;
+        std::vector<std::span<double>> y;
+        for (auto& ys : grid_ys)
+          y.push_back(std::span(ys).subspan(begin, points));
+        evaluate(std::span(xs).subspan(begin, points), y);
+        return;
+      }
+      std::vector<size_t> index;
+      std::vector<double> x;
+      for (size_t i = 0; i < points; i += stride) {
+        if (done != 0 && i % done == 0) continue;
+        if (found[begin + i] == curves.size()) continue;
+        xs[begin + i] = (k + (int64_t)i) * delta_x;
+        index.push_back(begin + i);
+        x.push_back(xs[begin + i]);
+      }
+      std::vector<std::vector<double>> y(curves.size(),
+                                         std::vector<double>(x.size()));
+      evaluate(x, std::vector<std::span<double>>(y.begin(), y.end()));
+      for (size_t curve = 0; curve != curves.size(); ++curve) {
+        for (size_t n = 0; n != index.size(); ++n)
+          grid_ys[curve][index[n]] = y[curve][n];
+      }
+    });
+  };
+  // appends samples of tile within the screen
+  double x_min = k_lo * delta_x, x_max = k_hi * delta_x;
+  auto visible = [x_min, x_max](const TileCache::Tile& tile,
+                                std::vector<Sample>* samples) {
+    for (const auto& sample : tile) {
+      if (sample.first >= x_min && sample.first <= x_max)
+        samples->push_back(sample);
+    }
+  };
+  if (progressive) {
+    const auto& tiles = curve_tiles[0];
+    const std::vector<double>& ys = grid_ys[0];
+    std::vector<size_t> slot(count);
+    for (size_t m = 0; m != missing.size(); ++m) slot[missing[m]] = m;
+    size_t done = 0;
+    for (size_t stride = COARSE_STRIDE; stride != 1; stride /= 4) {
+      pass(stride, done);
+      if (stop.stop_requested()) break;
+      std::vector<Sample> coarse;
+      TileCache::Tile grid;
+      for (size_t c = 0; c != count; ++c) {
+        if (tiles[c]) {
+          visible(*tiles[c], &coarse);
+          continue;
+        }
+        grid.clear();
+        for (size_t i = 0; i < points - 1; i += stride)
+          grid.emplace_back(xs[slot[c] * points + i], ys[slot[c] * points + i]);
+        visible(grid, &coarse);
+      }
+      Pass progress = {std::vector<Graphs>(1), false};
+      progress.graphs[0] = cut_subgraphs(coarse, y_lo, y_hi);
+      co_yield std::move(progress);
+      done = stride;
+    }
+    if (!stop.stop_requested()) pass(1, done);
+  } else {
+    pass(1, 0);
+  }
+  if (stop.stop_requested()) {
+    co_yield none;
+    co_return;
+  }
+  size_t threads = executor ? executor->concurrency() : 1;
+  std::vector<Graphs> result;
+  for (size_t curve = 0; curve != curves.size(); ++curve) {
+    if (stop.stop_requested()) {
+      co_yield none;
+      co_return;
+    }
+    const CompiledExpression& program = *curves[curve].program;
+    const std::vector<double>& ys = grid_ys[curve];
+    auto& tiles = curve_tiles[curve];
+    // tiles sampled for other curves may be cached for this one
+    std::vector<bool> fresh(missing.size());
+    for (size_t m = 0; m != missing.size(); ++m) fresh[m] = !tiles[missing[m]];
+    std::vector<Interval> intervals;
+    for (size_t m = 0; m != missing.size(); ++m) {
+      if (!fresh[m]) continue;
+      for (size_t n = m * points, end = n + points - 1; n != end; ++n) {
+        if (std::abs(ys[n + 1] - ys[n]) > delta_y)
+          intervals.push_back({xs[n], xs[n + 1], ys[n], ys[n + 1], m, 0});
+      }
+    }
+    std::vector<std::vector<std::vector<Sample>>> samples(
+        threads, std::vector<std::vector<Sample>>(missing.size()));
+    std::vector<int> depths(threads);
+    bool truncated = false;
+    if (budget.samples != 0 || budget.time.count() != 0) {
+      truncated = refine_within_budget(program, intervals, delta_y, bound_lo,
+                                       bound_hi, start, stop, &samples,
+                                       &depths);
+    } else if (executor) {
+      std::function<void(const Interval&, size_t)> task =
+          [&](const Interval& interval, size_t worker) {
+            refine(
+                program, interval, delta_y, bound_lo, bound_hi,
+                [&](const Interval& half) {
+                  executor->spawn(worker, [&task, half](size_t thief) {
+                    task(half, thief);
+                  });
+                },
+                stop, &samples[worker][interval.tile], &depths[worker]);
+          };
+      std::vector<Executor::Task> tasks;
+      for (const auto& interval : intervals) {
+        tasks.push_back([&task, interval](size_t worker) {
+          task(interval, worker);
+        });
+      }
+      executor->run(std::move(tasks));
+    } else {
+      std::vector<Interval> worklist(intervals.rbegin(), intervals.rend());
+      while (!worklist.empty()) {
+        Interval interval = worklist.back();
+        worklist.pop_back();
+        refine(
+            program, interval, delta_y, bound_lo, bound_hi,
+            [&](const Interval& half) { worklist.push_back(half); }, stop,
+            &samples[0][interval.tile], &depths[0]);
+      }
+    }
+    if (stop.stop_requested()) {
+      co_yield none;
+      co_return;
+    }
+    RefineStats stats;
+    for (size_t w = 0; w != threads; ++w) {
+      for (const auto& tile_samples : samples[w])
+        stats.samples += tile_samples.size();
+      stats.depth = std::max(stats.depth, depths[w]);
+    }
+    parallel_for(missing.size(), [&](size_t m) {
+      if (!fresh[m] || stop.stop_requested()) return;
+      TileCache::Tile tile;
+      for (size_t n = m * points, end = n + points - 1; n != end; ++n)
+        tile.emplace_back(xs[n], ys[n]);
+      for (const auto& worker_samples : samples)
+        tile.insert(tile.end(), worker_samples[m].begin(),
+                    worker_samples[m].end());
+      // grid alone is sorted and distinct
+      if (tile.size() != points - 1) {
+        std::sort(tile.begin(), tile.end(),
+                  [](const Sample& a, const Sample& b) {
+                    return a.first < b.first;
+                  });
+        tile.erase(std::unique(tile.begin(), tile.end(),
+                               [](const Sample& a, const Sample& b) {
+                                 return a.first == b.first;
+                               }),
+                   tile.end());
+      }
+      tiles[missing[m]] =
+          std::make_shared<const TileCache::Tile>(std::move(tile));
+    });
+    // tiles left unbuilt on stop are neither cached nor plotted
+    if (stop.stop_requested()) {
+      co_yield none;
+      co_return;
+    }
+    if (cache && !truncated) {
+      for (size_t m = 0; m != missing.size(); ++m) {
+        if (fresh[m])
+          cache->insert(key(curve, missing[m]), tiles[missing[m]]);
+      }
+    }
+    std::vector<Sample> screen;
+    for (const auto& tile : tiles) visible(*tile, &screen);
+    result.push_back(
+        cut_subgraphs(screen, y_lo, y_hi).decimated(x_lo, 1.0 / x_pix));
+    if (truncated) result.back().truncate();
+    result.back().set_refinement(stats);
+  }
+  Pass final = {std::move(result), true};
+  co_yield std::move(final);
+}
+
+/*!
+  Runs jobs on executor or serially if there is no executor
+  \param[in] count number of jobs
+  \param[in] body job taking index in range [0, count)
+*/
+void PlotableExpression::parallel_for(
+    size_t count, const std::function<void(size_t)>& body) const {
+  if (executor) {
+    executor->parallel_for(count, body);
+  } else {
+    for (size_t i = 0; i != count; ++i) body(i);
+  }
+}
+
+/*!
+  Finds tile in the cache or composes it from two tiles of twice finer
+  resolution as envelope of first, last, min and max samples of every
+  pixel column within runs of finite samples, undefined samples split
+  the runs, composed tile is cached
+  \param[in] key key of tile
+  \param[in] levels number of finer levels to look at
+  \return tile, nullptr if it can not be found or composed
+*/
+std::shared_ptr<const TileCache::Tile> PlotableExpression::lookup(
+    const TileCache::Key& key, int levels) const {
+  std::shared_ptr<const TileCache::Tile> tile = cache->find(key);
+  if (tile || levels == 0 || !std::isfinite(key.x_pix * 2)) return tile;
+  TileCache::Key left = key, right = key;
+  left.x_pix = right.x_pix = key.x_pix * 2;
+  left.tile = key.tile * 2;
+  right.tile = key.tile * 2 + 1;
+  std::shared_ptr<const TileCache::Tile> fine_left = lookup(left, levels - 1);
+  if (!fine_left) return nullptr;
+  std::shared_ptr<const TileCache::Tile> fine_right =
+      lookup(right, levels - 1);
+  if (!fine_right) return nullptr;
+  // envelope is taken of every run of finite samples, the first
+  // non-finite sample of a run of them is kept as separator of graphs
+  TileCache::Tile composed;
+  Graphs run;
+  auto envelope = [&] {
+    run.split();
+    Graphs decimated = run.decimated(0, 1.0 / key.x_pix);
+    if (!decimated.empty()) {
+      GraphView samples = decimated[0];
+      for (size_t i = 0; i != samples.size(); ++i)
+        composed.emplace_back(samples.x[i], samples.y[i]);
+    }
+    run = Graphs();
+  };
+  for (const auto& half : {fine_left, fine_right}) {
+    for (const auto& [x, y] : *half) {
+      if (std::isfinite(y)) {
+        run.push_back(x, y);
+        continue;
+      }
+      envelope();
+      if (composed.empty() || std::isfinite(composed.back().second))
+        composed.emplace_back(x, y);
+    }
+  }
+  envelope();
+  tile = std::make_shared<const TileCache::Tile>(std::move(composed));
+  cache->insert(key, tile);
+  return tile;
+}
+
+/*!
+  Finds values at grid points of the tile in cached tiles of coarser
+  resolution (zoom-in): grid points of a tile PYRAMID_LEVELS or fewer
+  octaves coarser and middles of its refinement lie on the finer grid,
+  coarse tiles are looked up with the same bounds of Y and with bounds
+  and resolution of Y coarser by as many octaves
+  \param[in] key key of the tile
+  \param[in] xs grid points of the tile, sorted
+  \param[out] ys values at the grid points found in coarse tiles
+  \param[in,out] found counter of values found for every grid point
+*/
+void PlotableExpression::seed(const TileCache::Key& key,
+                              std::span<const double> xs,
+                              std::span<double> ys,
+                              std::span<unsigned> found) const {
+  std::vector<unsigned char> seen(xs.size());
+  for (int level = 1; level <= PYRAMID_LEVELS; ++level) {
+    TileCache::Key coarse = key;
+    coarse.x_pix = std::ldexp(key.x_pix, -level);
+    coarse.tile = key.tile >> level;
+    TileCache::Key scaled = coarse;
+    scaled.y_pix = std::ldexp(key.y_pix, -level);
+    double height = std::ldexp((key.y_hi - key.y_lo) / 2, level);
+    scaled.y_lo = std::floor(key.y_lo / height) * height;
+    scaled.y_hi = scaled.y_lo + 2 * height;
+    for (const auto& candidate : {coarse, scaled}) {
+      std::shared_ptr<const TileCache::Tile> tile = cache->find(candidate);
+      if (!tile) continue;
+      auto sample = tile->begin();
+      for (size_t i = 0; i != xs.size(); ++i) {
+        while (sample != tile->end() && sample->first < xs[i]) ++sample;
+        if (sample == tile->end()) break;
+        if (sample->first != xs[i] || seen[i]) continue;
+        ys[i] = sample->second;
+        seen[i] = 1;
+        ++found[i];
+      }
+    }
+  }
+}
+
+/*!
+  Step of adaptive bisection: samples the middle with derivative and
+  checks if the jump or the curvature is visible on screen
+  \param[in] program compiled expression
+  \param[in] interval interval to bisect
+  \param[in] delta_y height of pixel
+  \param[in] y_lo lower bound of the screen
+  \param[in] y_hi upper bound of the screen
+  \param[out] samples receiver of samples
+  \param[in,out] depth maximum depth of samples
+  \param[out] left left half to be refined
+  \param[out] right right half to be refined
+  \return true if halves need refinement
+*/
+bool PlotableExpression::bisect(const CompiledExpression& program,
+                                const Interval& interval, double delta_y,
+                                double y_lo, double y_hi,
+                                std::vector<Sample>* samples, int* depth,
+                                Interval* left, Interval* right) const {
+  double x_min = interval.x_min, x_max = interval.x_max;
+  double y_min = interval.y_min, y_max = interval.y_max;
+  double x_mid = (x_min + x_max) / 2;
+  // depth limit and resolution of double: the middle must be a new X
+  if (interval.depth >= budget.depth || !(x_min < x_mid && x_mid < x_max))
+    return false;
+  // interval evaluation proves that the interval is off the screen
+  // or that the graph stays within a pixel of the box of its ends,
+  // then the segment between the ends, not wider than a pixel, covers
+  // the same pixels as the graph (monotone pieces, steep parts),
+  // empty range proves nothing and the interval is sampled
+  Range range = program.range(x_min, x_max);
+  if (!range.empty() &&
+      (range.lo > y_hi || range.hi < y_lo ||
+       (range.defined && range.lo > std::min(y_min, y_max) - delta_y &&
+        range.hi < std::max(y_min, y_max) + delta_y))) {
+    return false;
+  }
+  // middle on the chord and tangent parallel to the chord, the graph
+  // is straight within a pixel and needs no more samples, no values
+  // at the ends and in the middle, there is no graph to refine
+  Dual mid = program.dual(x_mid);
+  double y_mid = mid.value;
+  samples->emplace_back(x_mid, y_mid);
+  *depth = std::max(*depth, interval.depth + 1);
+  if ((std::abs(y_mid - (y_min + y_max) / 2) < delta_y / 2 &&
+       std::abs(mid.derivative * (x_max - x_min) - (y_max - y_min)) <
+           delta_y) ||
+      std::abs(y_mid - y_min) < delta_y ||
+      (std::isnan(y_min) && std::isnan(y_mid) && std::isnan(y_max)) ||
+      (y_min < y_mid && y_min > y_hi) || (y_max < y_mid && y_max > y_hi) ||
+      (y_max > y_mid && y_max < y_lo) || (y_min > y_mid && y_min < y_lo)) {
+    return false;
+  }
+  *left = {x_min, x_mid, y_min, y_mid, interval.tile, interval.depth + 1};
+  *right = {x_mid, x_max, y_mid, y_max, interval.tile, interval.depth + 1};
+  return true;
+}
+
+/*!
+  Adaptive bisection of the interval: while halves need refinement,
+  spawns the right half and goes on with the left one
+  \param[in] program compiled expression
+  \param[in] interval interval to refine
+  \param[in] delta_y height of pixel
+  \param[in] y_lo lower bound of the screen
+  \param[in] y_hi upper bound of the screen
+  \param[in] spawn receiver of halves to be refined later
+  \param[in] stop token of cancellation
+  \param[out] samples receiver of samples
+  \param[in,out] depth maximum depth of samples
+*/
+void PlotableExpression::refine(
+    const CompiledExpression& program, Interval interval, double delta_y,
+    double y_lo, double y_hi, const std::function<void(const Interval&)>& spawn,
+    const std::stop_token& stop, std::vector<Sample>* samples,
+    int* depth) const {
+  Interval left, right;
+  while (!stop.stop_requested() &&
+         bisect(program, interval, delta_y, y_lo, y_hi, samples, depth, &left,
+                &right)) {
+    spawn(right);
+    interval = left;
+  }
+}
+
+/*!
+  Adaptive bisection of intervals within budget of samples and time:
+  the interval with the largest visible jump (the widest one of equal
+  jumps) is bisected first, so the budget is spent where the error of
+  the graph is the largest. Intervals are dealt by priority to shards,
+  one per receiver of samples, shards are refined in parallel by DI
+  executor each with its own priority queue, and share the count of
+  samples and the deadline.
+  \param[in] program compiled expression
+  \param[in] intervals intervals to refine
+  \param[in] delta_y height of pixel
+  \param[in] y_lo lower bound of the screen
+  \param[in] y_hi upper bound of the screen
+  \param[in] start start time of plotting
+  \param[in] stop token of cancellation
+  \param[out] samples receivers of samples per shard and per tile
+  \param[in,out] depths maximum depth of samples per shard
+  \return true if budget ran out before refinement was complete
+*/
+bool PlotableExpression::refine_within_budget(
+    const CompiledExpression& program, const std::vector<Interval>& intervals,
+    double delta_y, double y_lo, double y_hi,
+    std::chrono::steady_clock::time_point start, const std::stop_token& stop,
+    std::vector<std::vector<std::vector<Sample>>>* samples,
+    std::vector<int>* depths) const {
+  // jump is clipped to the screen, NaN end counts as the whole screen
+  auto error = [y_lo, y_hi](const Interval& interval) {
+    double jump = std::abs(interval.y_max - interval.y_min);
+    return std::isnan(jump) ? y_hi - y_lo : std::min(jump, y_hi - y_lo);
+  };
+  auto less = [&error](const Interval& a, const Interval& b) {
+    double error_a = error(a), error_b = error(b);
+    if (error_a != error_b) return error_a < error_b;
+    return a.x_max - a.x_min < b.x_max - b.x_min;
+  };
+  // every shard gets its share of the largest jumps
+  std::vector<Interval> sorted = intervals;
+  std::sort(sorted.begin(), sorted.end(),
+            [&less](const Interval& a, const Interval& b) {
+              return less(b, a);
+            });
+  std::vector<std::vector<Interval>> shards(samples->size());
+  for (size_t i = 0; i != sorted.size(); ++i)
+    shards[i % shards.size()].push_back(sorted[i]);
+  std::atomic<size_t> count = 0;
+  std::atomic<bool> truncated = false;
+  parallel_for(shards.size(), [&](size_t shard) {
+    std::priority_queue<Interval, std::vector<Interval>, decltype(less)>
+        queue(less, shards[shard]);
+    while (!queue.empty() && !stop.stop_requested()) {
+      if ((budget.samples != 0 && count.load() >= budget.samples) ||
+          (budget.time.count() != 0 &&
+           std::chrono::steady_clock::now() - start >= budget.time)) {
+        truncated = true;
+        return;
+      }
+      Interval interval = queue.top(), left, right;
+      queue.pop();
+      std::vector<Sample>& tile_samples = (*samples)[shard][interval.tile];
+      size_t before = tile_samples.size();
+      if (bisect(program, interval, delta_y, y_lo, y_hi, &tile_samples,
+                 &(*depths)[shard], &left, &right)) {
+        queue.push(left);
+        queue.push(right);
+      }
+      count += tile_samples.size() - before;
+    }
+  });
+  return truncated;
+}
+
+/*!
+  Cuts sorted samples into graphs of samples on the screen. Graph keeps
+  finite neighbour samples off the screen at its ends, so the graph
+  is drawn up to the edge of the screen by QCustomPlot clipping.
+  \param[in] samples samples sorted by X
+  \param[in] y_lo lower bound of the screen
+  \param[in] y_hi upper bound of the screen
+  \return graphs
+*/
+Graphs PlotableExpression::cut_subgraphs(const std::vector<Sample>& samples,
+                                         double y_lo, double y_hi) const {
+  Graphs graphs;
+  graphs.reserve(samples.size());
+  auto visible = [&](size_t i) {
+    return samples[i].second >= y_lo && samples[i].second <= y_hi;
+  };
+  for (size_t i = 0; i != samples.size(); ++i) {
+    const auto& [key, value] = samples[i];
+    if (visible(i)) {
+      if (i != 0 && !visible(i - 1) && std::isfinite(samples[i - 1].second))
+        graphs.push_back(samples[i - 1].first, samples[i - 1].second);
+      graphs.push_back(key, value);
+    } else {
+      if (i != 0 && visible(i - 1) && std::isfinite(value))
+        graphs.push_back(key, value);
+      graphs.split();
+    }
+  }
+  graphs.split();
+  return graphs;
+}
+
+CalculatorModel::~CalculatorModel() { delete result; }
+
+/*!
+  Handles most button presses (except Plot), updates expression and result.
+  Catches and stores error messages on failure.
+  \param[in] button button input string
+*/
+void CalculatorModel::modify(const std::string& button) const {
+  if (button == "AC") {
+    comp_expression_x->clear();
+    result->clear();
+  } else if (button == "=") {
+    try {
+      *result = readble_dblToStr(comp_expression_x->solution());
+    } catch (const std::string& message) {
+      *result = message;
+    }
+  } else {
+    comp_expression_x->edit(button);
+  }
+}
+
+/*!
+  Returns the current expression string.
+  \return string representation of expression
+*/
+std::string CalculatorModel::expression() const {
+  return comp_expression_x->string();
+}
+
+/*!
+  Returns the current computed result or error message.
+  \return string value of solution
+*/
+std::string CalculatorModel::some_result() const { return *result; }
 
 std::string CalculatorModel::readble_dblToStr(double num) const {
   char buffer[DBL_DIG * 2];
@@ -506,10 +2774,9 @@ void CalculatorModel::edit_variable(const std::string& var_value) const {
   Handles Plot and AC button presses.
   \return vector of graph data (can be empty on error)
 */
-std::vector<std::map<double, double>> CalculatorModel::graphs(
-    double x_lo, double x_hi, int x_pix, double y_lo, double y_hi,
-    int y_pix) const {
-  std::vector<std::map<double, double>> graph_vector;
+Graphs CalculatorModel::graphs(double x_lo, double x_hi, double x_pix,
+                               double y_lo, double y_hi, double y_pix) const {
+  Graphs graph_vector;
   if (!expression().empty()) {
     try {
       graph_vector =
@@ -521,4 +2788,65 @@ std::vector<std::map<double, double>> CalculatorModel::graphs(
   return graph_vector;
 }
 
+/*!
+  Handles Plot and AC button presses off the calling thread: compiles
+  expression now, errors of compilation are stored as result.
+  \param[in] progress receiver of coarse graphs, may be empty
+  \return job generating graphs (empty on error or cancellation)
+*/
+GraphsJob CalculatorModel::graphs_job(double x_lo, double x_hi, double x_pix,
+                                      double y_lo, double y_hi, double y_pix,
+                                      GraphsSink progress) const {
+  if (!expression().empty()) {
+    try {
+      GraphsJob job = graph_plot_expression->plot(x_lo, x_hi, x_pix, y_lo,
+                                                  y_hi, y_pix, progress);
+      return [job](std::stop_token stop) {
+        try {
+          return job(stop);
+        } catch (const std::string&) {
+          return Graphs();
+        }
+      };
+    } catch (const std::string& message) {
+      *result = message;
+    }
+  }
+  return [](std::stop_token) { return Graphs(); };
+}
+
+/*!
+  Handles Plot and AC button presses as a coroutine: compiles expression
+  now, errors of compilation are stored as result, passes of plotting
+  run on the thread resuming the generator, so the time budget of
+  refinement applies to the plot as a whole.
+  \return generator of coarse and final graphs
+*/
+Generator<Graphs> CalculatorModel::graphs_async(double x_lo, double x_hi,
+                                                double x_pix, double y_lo,
+                                                double y_hi, double y_pix,
+                                                std::stop_token stop) const {
+  Generator<Graphs> passes = no_graphs();
+  if (!expression().empty()) {
+    try {
+      passes = graph_plot_expression->plot_async(x_lo, x_hi, x_pix, y_lo,
+                                                 y_hi, y_pix, stop);
+    } catch (const std::string& message) {
+      *result = message;
+    }
+  }
+  return stream_graphs(std::move(passes), stop);
+}
+
+/*!
+  Solves expression when the result is taken
+  \return generator of the result or error message
+*/
+Generator<std::string> CalculatorModel::solve_async(
+    std::stop_token stop) const {
+  if (stop.stop_requested()) co_return;
+  modify("=");
+  co_yield some_result();
+}
+
 }  // namespace scn
@@ -5,19 +5,38 @@
 #ifndef MODEL_H
 #define MODEL_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cfloat>
+#include <cstdint>
+#include <functional>
+#include <charconv>
+#include <chrono>
+#include <coroutine>
+#include <exception>
 #include <iostream>
+#include <iterator>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <stdexcept>
+#include <stop_token>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "lib/functions.h"
 
 /*!
   \def Safe char* buffer size for arbitrary double conversion
-  to char* in hexadecimal format (with "a" specifier) to save
-  exact double representation
+  to char* in the shortest exact representation
 */
 #define BUF_SIZE 64
 
@@ -71,7 +90,105 @@
       {"-", 1},            \
   }
 
+/*!
+  \def Initialization list of operation codes for
+  class OpcodeTable lexeme classification
+*/
+#define OPCODE_MAP                         \
+  {                                        \
+      {"X", Opcode::variable},             \
+      {"(", Opcode::left_bracket},         \
+      {")", Opcode::right_bracket},        \
+      {"unary +", Opcode::unary_plus},     \
+      {"unary -", Opcode::unary_minus},    \
+      {"sin", Opcode::sin},                \
+      {"cos", Opcode::cos},                \
+      {"tan", Opcode::tan},                \
+      {"asin", Opcode::asin},              \
+      {"acos", Opcode::acos},              \
+      {"atan", Opcode::atan},              \
+      {"ln", Opcode::ln},                  \
+      {"log", Opcode::log},                \
+      {"sqrt", Opcode::sqrt},              \
+      {"^", Opcode::pow},                  \
+      {"*", Opcode::mult},                 \
+      {"/", Opcode::div},                  \
+      {"mod", Opcode::mod},                \
+      {"+", Opcode::plus},                 \
+      {"-", Opcode::minus},                \
+  }
+
+/*!
+  \def Number of variable values evaluated together by batch
+  evaluation, one column of the calculating stack per block
+*/
+#define BATCH_SIZE 256
+
 namespace scn {
+/*!
+  \brief Class - Table of token properties indexed by operation code
+
+  Classifies lexeme into operation code with single lookup, after that
+  function object, arity and precedence of the token are taken from
+  arrays indexed by operation code. Lexemes absent in the table
+  (digits, dot, exponent) are parts of numbers.
+  Owns function objects and therefore is not copyable, the table is
+  immutable and one instance is shared by all evaluators and threads.
+*/
+class OpcodeTable {
+ public:
+  OpcodeTable();
+  OpcodeTable(const OpcodeTable&) = delete;
+  OpcodeTable& operator=(const OpcodeTable&) = delete;
+  ~OpcodeTable();
+
+  /*!
+    Provides the table shared by all users, built on the first call
+    \return shared table
+  */
+  static const OpcodeTable& shared();
+
+  /*!
+    Classifies lexeme
+    \param[in] lexeme button or token string
+    \return operation code, Opcode::number for parts of numbers
+  */
+  Opcode opcode(const std::string& lexeme) const;
+
+  /*!
+    Provides function object of operation code
+    \param[in] opcode operation code
+    \return function object or nullptr if opcode is not a function
+  */
+  const Function* function(Opcode opcode) const {
+    return functions[static_cast<size_t>(opcode)];
+  }
+
+  /*!
+    Provides arity of operation code
+    \param[in] opcode operation code
+    \return function arity, 0 if opcode is not a function
+  */
+  int arity(Opcode opcode) const {
+    return arities[static_cast<size_t>(opcode)];
+  }
+
+  /*!
+    Provides precedence of operation code
+    \param[in] opcode operation code
+    \return function precedence, 0 if opcode is not a function
+  */
+  int precedence(Opcode opcode) const {
+    return precedences[static_cast<size_t>(opcode)];
+  }
+
+ private:
+  const std::map<std::string, Opcode> opcodes;
+  std::array<Function*, OPCODE_COUNT> functions;
+  std::array<int, OPCODE_COUNT> arities;
+  std::array<int, OPCODE_COUNT> precedences;
+};
+
 /*!
   \brief Interface - abstraction of operator stack used in Shunting Yard
   alghorithm
@@ -145,16 +262,16 @@ class ShuntingYardAlgorithmStack {
 /*!
   \brief Class - Shunting Yard alghorithm operator stack
 
-  Allows DI of stack memory, ptr to map of supported functions for
-  properties (arity, associativity) and ptr to map of function
-  precedence for converting infix notation into reverse polish notation.
+  Keeps operation code of every token alongside the token, so
+  properties (arity, associativity, precedence) of functions for
+  converting infix notation into reverse polish notation are
+  taken from the table of operation codes by array index.
 */
 class ShuntingYardStringStack : public ShuntingYardAlgorithmStack {
  public:
   ShuntingYardStringStack()
       : stack(new std::vector<std::string>),
-        functions(FUNCTION_MAP),
-        func_precedence(PRECEDENCE_MAP) {}
+        opcodes(new std::vector<Opcode>) {}
   ~ShuntingYardStringStack();
   void push(const std::string& token) const override;
   void pop_multiple(std::vector<std::string> tokens) const override;
@@ -168,8 +285,8 @@ class ShuntingYardStringStack : public ShuntingYardAlgorithmStack {
 
  private:
   std::vector<std::string>* const stack;
-  const std::map<std::string, Function*> functions;
-  const std::map<std::string, int> func_precedence;
+  std::vector<Opcode>* const opcodes;
+  const OpcodeTable& table = OpcodeTable::shared();
 };
 /*!
   \brief Interface - abstraction for postfixable expressions
@@ -225,7 +342,7 @@ class PostfixStringExpression : public PostfixableExpression {
   */
   PostfixStringExpression(const ShuntingYardAlgorithmStack* const stack)
       : expression(new std::vector<std::string>),
-        functions(FUNCTION_MAP),
+        lexemes(new std::vector<Opcode>),
         stack(stack) {}
   ~PostfixStringExpression();
   void edit(const std::string& button) const override;
@@ -237,8 +354,10 @@ class PostfixStringExpression : public PostfixableExpression {
  private:
   void append_tokens(std::vector<std::string> src,
                      std::vector<std::string>* dest) const;
+  bool operand(Opcode opcode) const;
   std::vector<std::string>* const expression;
-  const std::map<std::string, Function*> functions;
+  std::vector<Opcode>* const lexemes;
+  const OpcodeTable& table = OpcodeTable::shared();
   const ShuntingYardAlgorithmStack* const stack;
 };
 
@@ -255,6 +374,12 @@ class CalculatingStack {
   */
   virtual void push(const std::string& token) const = 0;
 
+  /*!
+    Pushes a number onto the stack without string conversion.
+    \param[in] number input number
+  */
+  virtual void push(double number) const = 0;
+
   /*!
     Returns the top value of the stack.
     \return top value as double
@@ -274,17 +399,290 @@ class CalculatingStack {
 */
 class CalculatingDblStack : public CalculatingStack {
  public:
-  CalculatingDblStack()
-      : stack(new std::vector<double>), functions(FUNCTION_MAP) {}
+  CalculatingDblStack() : stack(new std::vector<double>) {}
   ~CalculatingDblStack();
   void push(const std::string& token) const override;
+  void push(double number) const override;
   double top() const override;
   void clear() const override;
 
  private:
-  double strToDbl(const std::string& str) const;
   std::vector<double>* const stack;
-  const std::map<std::string, Function*> functions;
+  const OpcodeTable& table = OpcodeTable::shared();
+};
+
+/*!
+  \brief Interface - abstraction of expression compiled once
+  for repeated evaluation with different values of variable X
+*/
+class CompiledExpression {
+ public:
+  virtual ~CompiledExpression() {}  // LCOV_EXCL_LINE
+
+  /*!
+    Computes the expression with variable X bound to the input value.
+    \param[in] x value of variable X
+    \return numeric solution
+  */
+  virtual double solution(double x) const = 0;
+
+  /*!
+    Computes the expression for every value of variable X.
+    \param[in] xs values of variable X
+    \param[out] out solutions, same size as xs
+  */
+  virtual void solutions(std::span<const double> xs,
+                         std::span<double> out) const = 0;
+
+  /*!
+    Interval evaluation: encloses values of the expression
+    for every X in [x_lo, x_hi].
+    \param[in] x_lo lower bound of X
+    \param[in] x_hi upper bound of X
+    \return range of values
+  */
+  virtual Range range(double x_lo, double x_hi) const = 0;
+
+  /*!
+    Dual evaluation: computes the expression and its derivative by X
+    in one pass (forward-mode automatic differentiation).
+    \param[in] x value of variable X
+    \return value and derivative, value equals solution(x)
+  */
+  virtual Dual dual(double x) const = 0;
+};
+
+/*!
+  \brief Class - Immutable program compiled from postfix tokens
+
+  Tokens are classified into operation codes and numbers are converted
+  into pool of constants once during compilation, so evaluation is
+  a single pass over compact tokens with dispatch by array index
+  without string parsing or Shunting Yard sorting.
+  Batch evaluation runs the program column-wise: stack slots hold
+  blocks of BATCH_SIZE values and every token is a loop over the block.
+  Program owns its table of operation codes and therefore is not copyable.
+*/
+class ExpressionProgram : public CompiledExpression {
+ public:
+  /*!
+    Constructor - compiles the program
+    \param[in] postfix tokens in postfix notation
+  */
+  explicit ExpressionProgram(const std::vector<std::string>& postfix);
+
+  /*!
+    Constructor - program from already compiled tokens
+    \param[in] code tokens in postfix order
+    \param[in] constants pool of constants referenced by number tokens
+  */
+  ExpressionProgram(std::vector<Token> code, std::vector<double> constants);
+  ExpressionProgram(const ExpressionProgram&) = delete;
+  ExpressionProgram& operator=(const ExpressionProgram&) = delete;
+  double solution(double x) const override;
+  void solutions(std::span<const double> xs,
+                 std::span<double> out) const override;
+  Range range(double x_lo, double x_hi) const override;
+  Dual dual(double x) const override;
+
+  /*!
+    Optimization pass: folds subexpressions independent of X into
+    constants and removes operations that never change the operand
+    (unary plus, double negation, x*1, 1*x, x/1, x^1, x-0, x+(-0)).
+    Identities are applied only when they hold for every IEEE value
+    including NaN, Inf and signed zero, so x+0 is not simplified.
+    \param[out] removed number of removed tokens, may be nullptr
+    \return optimized program
+  */
+  ExpressionProgram optimized(size_t* removed = nullptr) const;
+
+  /*!
+    Provides compiled code of the program
+    \return tokens in postfix order
+  */
+  const std::vector<Token>& tokens() const { return code; }
+
+  /*!
+    Provides pool of constants referenced by number tokens
+    \return values of constants
+  */
+  const std::vector<double>& pool() const { return constants; }
+
+ private:
+  void block_solutions(const double* xs, double* out, size_t size,
+                       double* columns) const;
+  const OpcodeTable& table = OpcodeTable::shared();
+  std::vector<Token> code;
+  std::vector<double> constants;
+  size_t depth;
+};
+
+/*!
+  \brief Struct - node of expression tree or DAG built from postfix tokens
+
+  Operands are indices of nodes: a is the top of calculating stack
+  (right operand), b is the next one (left operand of binary function).
+  Number node keeps its value, operands of leaf nodes are unused.
+*/
+struct ExpressionNode {
+  Opcode opcode;
+  double value;
+  size_t a;
+  size_t b;
+};
+
+/*!
+  \brief Class - Expression DAG with common subexpressions merged
+
+  Built from compiled program by hash-consing: node with the same
+  operation and the same operands as existing node is not created
+  again, so every distinct subexpression (like sin(X) in
+  sin(X)*sin(X)+cos(X)*sin(X)) is computed once per X. Operands of
+  plus and mult are not reordered, as it changes NaN propagation.
+  Nodes are kept in topological order (operands before node) and
+  only nodes reachable from the result are kept.
+*/
+class ExpressionDag : public CompiledExpression {
+ public:
+  /*!
+    Constructor - builds the DAG
+    \param[in] program compiled program
+  */
+  explicit ExpressionDag(const ExpressionProgram& program);
+  ExpressionDag(const ExpressionDag&) = delete;
+  ExpressionDag& operator=(const ExpressionDag&) = delete;
+  double solution(double x) const override;
+  void solutions(std::span<const double> xs,
+                 std::span<double> out) const override;
+  Range range(double x_lo, double x_hi) const override;
+  Dual dual(double x) const override;
+
+  /*!
+    Provides distinct nodes of the DAG
+    \return nodes in topological order, the last one is the result
+  */
+  const std::vector<ExpressionNode>& nodes() const { return dag; }
+
+  /*!
+    Provides canonical signature of the DAG
+    \return bytes of nodes, equal if and only if DAGs are equal
+  */
+  std::string signature() const;
+
+ private:
+  void block_solutions(const double* xs, double* out, size_t size,
+                       double* columns) const;
+  const OpcodeTable& table = OpcodeTable::shared();
+  std::vector<ExpressionNode> dag;
+};
+
+/*!
+  \brief Class - DAG of several expressions evaluated in one pass
+
+  Built from DAGs of expressions by hash-consing their nodes, so X and
+  every subexpression shared by expressions (like sin(X) in sin(X) and
+  sin(X)^2) are computed once per X.
+  Results of expressions are nodes of the DAG, not necessarily the last.
+*/
+class FusedExpressionDag {
+ public:
+  /*!
+    Constructor - builds the DAG
+    \param[in] dags DAGs of expressions, empty DAG computes 0
+  */
+  explicit FusedExpressionDag(const std::vector<const ExpressionDag*>& dags);
+  FusedExpressionDag(const FusedExpressionDag&) = delete;
+  FusedExpressionDag& operator=(const FusedExpressionDag&) = delete;
+  void solutions(std::span<const double> xs,
+                 const std::vector<std::span<double>>& outs) const;
+
+  /*!
+    Provides distinct nodes of the DAG
+    \return nodes in topological order
+  */
+  const std::vector<ExpressionNode>& nodes() const { return dag; }
+
+  /*!
+    Provides result nodes of expressions
+    \return indices of result nodes in order of programs
+  */
+  const std::vector<size_t>& roots() const { return results; }
+
+ private:
+  const OpcodeTable& table = OpcodeTable::shared();
+  std::vector<ExpressionNode> dag;
+  std::vector<size_t> results;
+};
+
+/*!
+  \brief Class - Native x86-64 code generated from ExpressionDag
+
+  Lowers the DAG to straight-line SSE2 machine code in an executable
+  memory page: every node has its stack frame slot and is computed once,
+  arithmetic and square root are single instructions, transcendental
+  functions, pow and fmod are calls to the same libm functions the
+  function classes use, so results are bit-identical to interpreter.
+  On other platforms, or if executable memory is not available,
+  evaluation falls back to the interpreter of the DAG transparently.
+  Allows DI of ptr to DAG, which must outlive this object.
+*/
+class NativeProgram : public CompiledExpression {
+ public:
+  /*!
+    Constructor - generates machine code
+    \param[in] dag pointer to expression DAG
+  */
+  explicit NativeProgram(const ExpressionDag* const dag);
+  NativeProgram(const NativeProgram&) = delete;
+  NativeProgram& operator=(const NativeProgram&) = delete;
+  ~NativeProgram();
+  double solution(double x) const override;
+  void solutions(std::span<const double> xs,
+                 std::span<double> out) const override;
+  Range range(double x_lo, double x_hi) const override;
+  Dual dual(double x) const override;
+
+  /*!
+    Checks if machine code is generated
+    \return true if native code is used, false if interpreter is used
+  */
+  bool native() const { return entry != nullptr; }
+
+ private:
+  using Entry = double (*)(double x, const double* constants);
+  std::vector<unsigned char> generate();
+  const ExpressionDag* const dag;
+  std::vector<double> constants;
+  void* page;
+  size_t page_size;
+  Entry entry;
+};
+
+/*!
+  \brief Class - Derivative of compiled expression by X
+
+  Evaluates derivative of DI compiled expression by its dual evaluation,
+  so derivative curve costs about the same as the expression itself.
+  Interval evaluation of derivative is not supported, range is
+  unbounded, and second derivative is NaN.
+  Allows DI of ptr to compiled expression, which must outlive this object.
+*/
+class DerivativeProgram : public CompiledExpression {
+ public:
+  /*!
+    Constructor
+    \param[in] program pointer to compiled expression
+  */
+  explicit DerivativeProgram(const CompiledExpression* const program)
+      : program(program) {}
+  double solution(double x) const override;
+  void solutions(std::span<const double> xs,
+                 std::span<double> out) const override;
+  Range range(double x_lo, double x_hi) const override;
+  Dual dual(double x) const override;
+
+ private:
+  const CompiledExpression* const program;
 };
 
 /*!
@@ -318,6 +716,12 @@ class ComputableExpression {
     \return numeric solution
   */
   virtual double solution() const = 0;
+
+  /*!
+    Compiles the expression into program for repeated evaluation.
+    \return compiled expression program
+  */
+  virtual ExpressionProgram program() const = 0;
 };
 
 /*!
@@ -339,29 +743,49 @@ class ComputableStringExpression : public ComputableExpression {
   void clear() const override;
   std::string string() const override;
   double solution() const override;
+  ExpressionProgram program() const override;
 
  private:
   const PostfixableExpression* const expression;
   const CalculatingStack* const calc_stack;
 };
 
+/*!
+  \brief Struct - Variable bound natively as double
+
+  Value is converted from string once on assignment. Conversion error
+  is kept and reported when the variable is used in calculation, as
+  it happens with variable bound as string.
+*/
+struct Variable {
+  double value = 0;
+  std::string error;
+};
+
 /*!
   \brief Class - Decorator for CalculatingStack supporting variable substitution
 
   Substitutes a variable value (e.g., "X") during evaluation.
+  Variable is bound either as string, converted on every substitution,
+  or natively as double, pushed without conversion.
 */
 class CalculatingStack_with_variable : public CalculatingStack {
  public:
   CalculatingStack_with_variable(const CalculatingStack* const stack,
                                  std::string* const str_var)
-      : stack(stack), X_str_var(str_var) {}
+      : stack(stack), X_str_var(str_var), X_var(nullptr) {}
+  CalculatingStack_with_variable(const CalculatingStack* const stack,
+                                 const Variable* const var)
+      : stack(stack), X_str_var(nullptr), X_var(var) {}
   void push(const std::string& token) const override;
+  void push(double number) const override;
   double top() const override;
   void clear() const override;
 
  private:
   const CalculatingStack* const stack;
   std::string* const X_str_var;
+  const Variable* const X_var;
 };
 
 /*!
@@ -378,12 +802,29 @@ class ComputExpressionWithVariable : public ComputableExpression {
     \param[in] var_value value as a string
   */
   virtual void edit_variable(const std::string& var_value) const = 0;
+
+  /*!
+    Updates the internal variable value without string conversion.
+    \param[in] var_value value as a double
+  */
+  virtual void edit_variable(double var_value) const = 0;
+
+  /*!
+    Computes the expression for every value of variable X,
+    the expression is compiled once for the whole batch.
+    \param[in] xs values of variable X
+    \param[out] out solutions, same size as xs
+  */
+  virtual void solutions(std::span<const double> xs,
+                         std::span<double> out) const = 0;
 };
 
 /*!
   \brief Class - Computes result of expression with a variable
 
   Wraps another computable expression and allows updating variable value.
+  Variable is shared with CalculatingStack_with_variable either
+  as string or natively as double.
 */
 class ComputStrExpressionWithVariable : public ComputExpressionWithVariable {
  public:
@@ -395,16 +836,445 @@ class ComputStrExpressionWithVariable : public ComputExpressionWithVariable {
   ComputStrExpressionWithVariable(
       const ComputableExpression* const comp_expression,
       std::string* const str_var)
-      : comp_expression(comp_expression), X_str_var(str_var) {}
+      : comp_expression(comp_expression), X_str_var(str_var), X_var(nullptr) {}
+
+  /*!
+    Constructor
+    \param[in] comp_expression base expression
+    \param[in] var pointer to variable bound as double
+  */
+  ComputStrExpressionWithVariable(
+      const ComputableExpression* const comp_expression, Variable* const var)
+      : comp_expression(comp_expression), X_str_var(nullptr), X_var(var) {}
   void edit(const std::string& button) const override;
   void clear() const override;
   std::string string() const override;
   double solution() const override;
+  ExpressionProgram program() const override;
   void edit_variable(const std::string& var_value) const override;
+  void edit_variable(double var_value) const override;
+  void solutions(std::span<const double> xs,
+                 std::span<double> out) const override;
 
  private:
   const ComputableExpression* const comp_expression;
   std::string* const X_str_var;
+  Variable* const X_var;
+};
+
+/*!
+  \def Number of pixels of uniform grid per tile, tile is the unit
+  of parallel sampling and of caching, must be a multiple of COARSE_STRIDE
+*/
+#define TILE_SAMPLES 1024
+
+/*!
+  \def Number of finer levels of tile pyramid a missing tile
+  may be composed from
+*/
+#define PYRAMID_LEVELS 3
+
+/*!
+  \def Default memory cap of tile cache in bytes
+*/
+#define TILE_CACHE_CAPACITY (64 << 20)
+
+/*!
+  \def Stride in pixels of the first coarse pass of progressive plotting,
+  every next pass has 4 times smaller stride, must be a power of 4
+*/
+#define COARSE_STRIDE 16
+
+/*!
+  \def Wall-clock budget of interactive plotting in milliseconds
+*/
+#define PLOT_TIME_BUDGET_MS 100
+
+/*!
+  \def Default maximum depth of adaptive bisection of a pixel of the grid
+*/
+#define REFINE_DEPTH 32
+
+/*!
+  \def Number of samples in a block streamed from plotting to the view
+*/
+#define SAMPLE_BLOCK_SIZE 512
+
+/*!
+  \def Default number of blocks in the ring of streamed samples
+*/
+#define SAMPLE_RING_CAPACITY 64
+
+/*!
+  \brief Interface - abstraction of parallel executor of jobs and of
+  tasks spawning subtasks
+*/
+class Executor {
+ public:
+  /*!
+    Task taking index of worker thread running it,
+    the index is used to spawn subtasks and for per-worker buffers
+  */
+  using Task = std::function<void(size_t worker)>;
+
+  virtual ~Executor() {}  // LCOV_EXCL_LINE
+
+  /*!
+    Runs body for every index, returns when all bodies are finished.
+    First exception thrown by a body is rethrown to the caller.
+    \param[in] count number of jobs
+    \param[in] body job taking index in range [0, count)
+  */
+  virtual void parallel_for(
+      size_t count, const std::function<void(size_t)>& body) const = 0;
+
+  /*!
+    Runs tasks and all subtasks spawned by them, returns when all
+    are finished. First exception thrown by a task is rethrown.
+    \param[in] tasks root tasks
+  */
+  virtual void run(std::vector<Task> tasks) const = 0;
+
+  /*!
+    Spawns subtask, may be called only from a task run by the executor
+    \param[in] worker index of worker running the calling task
+    \param[in] task subtask
+  */
+  virtual void spawn(size_t worker, Task task) const = 0;
+
+  /*!
+    Provides number of threads running jobs
+    \return number of threads, worker indices are in [0, concurrency)
+  */
+  virtual size_t concurrency() const = 0;
+};
+
+/*!
+  \brief Class - Work-stealing pool of worker threads implementing Executor
+
+  Workers are started once and wait for tasks, calling thread takes part
+  in running tasks as worker 0. Every worker has its own deque of tasks:
+  spawned subtasks go to the back of worker's deque and are taken from
+  the back (depth-first, hot in cache), idle worker steals from the front
+  of other deques (the oldest, usually the largest, tasks).
+  Calls of run and parallel_for are serialized and must not be nested.
+*/
+class ThreadPool : public Executor {
+ public:
+  /*!
+    Constructor - starts worker threads
+    \param[in] threads total number of threads including calling thread
+  */
+  explicit ThreadPool(size_t threads = std::thread::hardware_concurrency());
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+  void parallel_for(size_t count,
+                    const std::function<void(size_t)>& body) const override;
+  void run(std::vector<Task> tasks) const override;
+  void spawn(size_t worker, Task task) const override;
+  size_t concurrency() const override;
+
+ private:
+  struct State;
+  void work(size_t worker) const;
+  bool take(size_t worker, Task* task) const;
+  State* const state;
+};
+
+/*!
+  \brief Struct - view of one graph, samples sorted by X
+*/
+struct GraphView {
+  std::span<const double> x;
+  std::span<const double> y;
+
+  size_t size() const;
+  double at(double key) const;
+};
+
+/*!
+  \brief Struct - statistics of adaptive refinement
+*/
+struct RefineStats {
+  size_t samples = 0;
+  int depth = 0;
+};
+
+/*!
+  \brief Class - graphs stored as contiguous samples
+
+  Samples of all graphs lie in two arrays x[] and y[] one after another,
+  graph i occupies samples [offsets[i], offsets[i + 1]). Samples are
+  appended by push_back and grouped into next graph by split.
+  Decimation keeps first, last, min and max sample of every pixel
+  column (M4) and counts dropped samples.
+*/
+class Graphs {
+ public:
+  size_t size() const;
+  bool empty() const;
+  size_t samples() const;
+  size_t dropped() const;
+  bool truncated() const;
+  void truncate();
+  const RefineStats& refinement() const;
+  void set_refinement(const RefineStats& stats);
+  GraphView operator[](size_t graph) const;
+  GraphView back() const;
+  void push_back(double x, double y);
+  void split();
+  void reserve(size_t samples);
+  Graphs decimated(double x_lo, double column) const;
+  bool operator==(const Graphs& other) const;
+
+ private:
+  std::vector<double> xs;
+  std::vector<double> ys;
+  std::vector<size_t> offsets = {0};
+  size_t dropped_samples = 0;
+  bool truncated_refinement = false;
+  RefineStats stats;
+};
+
+/*!
+  \brief Struct - budget of adaptive refinement, zero means unlimited
+
+  Samples are counted in refinement only, uniform grid is always
+  sampled. Time is wall-clock time since the start of plotting.
+  Depth of bisection is always limited, by REFINE_DEPTH by default.
+*/
+struct PlotBudget {
+  size_t samples = 0;
+  std::chrono::milliseconds time{0};
+  int depth = REFINE_DEPTH;
+
+  bool operator==(const PlotBudget& other) const = default;
+};
+
+/*!
+  Job generating graphs, may run on any thread,
+  returns early when stop is requested through the token
+*/
+using GraphsJob = std::function<Graphs(std::stop_token)>;
+
+/*!
+  Receiver of intermediate graphs of progressive plotting,
+  called on the thread running the job
+*/
+using GraphsSink = std::function<void(const Graphs&)>;
+
+/*!
+  \brief Class - Lazy sequence of values produced by a coroutine
+
+  Coroutine starts suspended and runs on the thread taking the next
+  value until it yields one or finishes, so the consumer decides where
+  and when the work is done and may drop the rest by destroying the
+  generator. Exception thrown by the coroutine is rethrown to the
+  consumer. Iterable by range-based for loop.
+*/
+template <class T>
+class Generator {
+ public:
+  /*!
+    \brief Struct - promise of the coroutine keeping the last value
+  */
+  struct promise_type {
+    std::optional<T> value;
+    std::exception_ptr error;
+    Generator get_return_object() {
+      return Generator(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    std::suspend_always yield_value(T yielded) {
+      value = std::move(yielded);
+      return {};
+    }
+    void return_void() {}
+    void unhandled_exception() { error = std::current_exception(); }
+  };
+
+  /*!
+    \brief Class - input iterator over values of the generator
+  */
+  class iterator {
+   public:
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    explicit iterator(Generator* generator = nullptr)
+        : generator(generator) {}
+    const T& operator*() const { return generator->value(); }
+    iterator& operator++() {
+      if (!generator->next()) generator = nullptr;
+      return *this;
+    }
+    void operator++(int) { ++*this; }
+    bool operator==(std::default_sentinel_t) const { return !generator; }
+
+   private:
+    Generator* generator;
+  };
+
+  explicit Generator(std::coroutine_handle<promise_type> handle)
+      : handle(handle) {}
+  Generator(Generator&& other) noexcept
+      : handle(std::exchange(other.handle, nullptr)) {}
+  Generator& operator=(Generator&& other) noexcept {
+    if (this != &other) {
+      if (handle) handle.destroy();
+      handle = std::exchange(other.handle, nullptr);
+    }
+    return *this;
+  }
+  ~Generator() {
+    if (handle) handle.destroy();
+  }
+
+  /*!
+    Runs the coroutine until it yields the next value or finishes
+    \return false if the coroutine has finished
+  */
+  bool next() {
+    if (!handle || handle.done()) return false;
+    handle.promise().value.reset();
+    handle.resume();
+    if (handle.promise().error)
+      std::rethrow_exception(std::exchange(handle.promise().error, nullptr));
+    return !handle.done();
+  }
+
+  /*!
+    \return the last value yielded
+  */
+  const T& value() const { return *handle.promise().value; }
+
+  /*!
+    Moves the last value yielded out of the generator
+    \return the last value yielded
+  */
+  T take() { return std::move(*handle.promise().value); }
+
+  iterator begin() { return iterator(next() ? this : nullptr); }
+  std::default_sentinel_t end() { return {}; }
+
+ private:
+  std::coroutine_handle<promise_type> handle;
+};
+
+/*!
+  \brief Class - LRU cache of sampled tiles of graphs
+
+  Tile is the sorted samples of expression (uniform grid and adaptive
+  refinement) over TILE_SAMPLES pixels of X. Tiles are keyed by signature
+  of compiled expression, number of tile, resolution and budget of
+  refinement, the least recently used tiles are evicted when memory of
+  tiles exceeds capacity.
+  Thread-safe.
+*/
+class TileCache {
+ public:
+  using Tile = std::vector<std::pair<double, double>>;
+
+  /*!
+    \brief Struct - key of tile
+  */
+  struct Key {
+    std::string expression;
+    bool derivative;
+    int64_t tile;
+    double x_pix;
+    double y_lo;
+    double y_hi;
+    double y_pix;
+    PlotBudget budget;
+
+    bool operator==(const Key& other) const = default;
+  };
+
+  /*!
+    Constructor
+    \param[in] capacity memory cap in bytes
+  */
+  explicit TileCache(size_t capacity = TILE_CACHE_CAPACITY)
+      : capacity(capacity) {}
+  TileCache(const TileCache&) = delete;
+  TileCache& operator=(const TileCache&) = delete;
+  std::shared_ptr<const Tile> find(const Key& key);
+  void insert(const Key& key, std::shared_ptr<const Tile> tile);
+  size_t size() const;
+  size_t memory() const;
+
+ private:
+  /*!
+    \brief Struct - hash of key of tile
+  */
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+  using Entry = std::pair<Key, std::shared_ptr<const Tile>>;
+  static size_t footprint(const Key& key, const Tile& tile);
+  const size_t capacity;
+  mutable std::mutex mutex;
+  std::list<Entry> lru;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+  size_t bytes = 0;
+};
+
+/*!
+  \brief Struct - block of samples of one graph streamed to the view
+
+  Blocks of a frame (coarse or final graphs of a plot) go in order of
+  graphs and of X, every frame has at least one block, so the receiver
+  replaces graphs when a block of new frame comes.
+*/
+struct SampleBlock {
+  uint64_t frame;
+  size_t graphs;
+  size_t graph;
+  size_t size;
+  std::array<double, SAMPLE_BLOCK_SIZE> x;
+  std::array<double, SAMPLE_BLOCK_SIZE> y;
+};
+
+/*!
+  \brief Class - Lock-free single-producer single-consumer ring of blocks
+
+  Plotting thread writes graphs as blocks of samples, GUI thread takes
+  them as they come, so memory is bounded by capacity of the ring however
+  many samples are plotted. Indices of the ring grow monotonically,
+  producer publishes a block by release store of tail after filling it
+  in place, consumer frees a block by release store of head after
+  reading it in place.
+  Writer sleeps while the ring is full until the reader frees a block
+  or stop is requested, both bump the counter of wakes it waits on.
+*/
+class SampleRing {
+ public:
+  /*!
+    Constructor
+    \param[in] capacity number of blocks, rounded up to a power of 2
+  */
+  explicit SampleRing(size_t capacity = SAMPLE_RING_CAPACITY);
+  SampleRing(const SampleRing&) = delete;
+  SampleRing& operator=(const SampleRing&) = delete;
+  bool push(const SampleBlock& block);
+  bool pop(SampleBlock* block);
+  SampleBlock* reserve();
+  void commit();
+  const SampleBlock* front() const;
+  void release();
+  bool write(const Graphs& graphs, uint64_t frame, std::stop_token stop);
+
+ private:
+  void wake();
+
+  std::vector<SampleBlock> blocks;
+  const size_t mask;
+  alignas(64) std::atomic<size_t> head = 0;
+  alignas(64) std::atomic<size_t> tail = 0;
+  alignas(64) std::atomic<uint32_t> wakes = 0;
 };
 
 /*!
@@ -415,43 +1285,165 @@ class Plotable {
   virtual ~Plotable() {}  // LCOV_EXCL_LINE
 
   /*!
-    Generates graphs over a defined x/y region and pixel space.
-    \return vector of graph maps (x->y points)
+    Generates graphs over a defined x/y region and pixel space,
+    resolution is in pixels per unit and may be a fraction.
+    \return graphs, every graph is sorted by X
   */
-  virtual std::vector<std::map<double, double>> graphs(double x_lo, double x_hi,
-                                                       int x_pix, double y_lo,
-                                                       double y_hi,
-                                                       int y_pix) const = 0;
+  virtual Graphs graphs(double x_lo, double x_hi, double x_pix,
+                        double y_lo, double y_hi, double y_pix) const = 0;
+
+  /*!
+    Compiles expression on calling thread and prepares job of plotting
+    over a defined x/y region and pixel space. With progress the job
+    passes coarse graphs to it before the final ones, final graphs
+    are the same as without progress.
+    \param[in] progress receiver of coarse graphs, may be empty
+    \return job generating graphs, empty graphs if stop is requested
+  */
+  virtual GraphsJob plot(double x_lo, double x_hi, double x_pix, double y_lo,
+                         double y_hi, double y_pix,
+                         GraphsSink progress = nullptr) const = 0;
+
+  /*!
+    Compiles expression on calling thread and prepares coroutine of
+    plotting over a defined x/y region and pixel space, which runs on
+    the thread resuming it and yields coarse graphs before the final
+    ones, final graphs are the same as of plot.
+    \param[in] stop token of cancellation
+    \return generator of graphs, empty final graphs if stop is requested
+  */
+  virtual Generator<Graphs> plot_async(double x_lo, double x_hi,
+                                       double x_pix, double y_lo,
+                                       double y_hi, double y_pix,
+                                       std::stop_token stop = {}) const = 0;
+
+  /*!
+    Generates graphs of several expressions over the same x/y region
+    and pixel space in one pass, expressions share the grid of X
+    and common subexpressions are computed once.
+    \param[in] expressions pointers to expressions with variable
+    \return graphs of every expression in the same order
+  */
+  virtual std::vector<Graphs> graphs(
+      const std::vector<const ComputExpressionWithVariable*>& expressions,
+      double x_lo, double x_hi, double x_pix, double y_lo, double y_hi,
+      double y_pix) const = 0;
 };
 
 /*!
   \brief Class - Implementation of Plotable for expressions with variables
 
-  Generates 2D graphs of expressions over defined regions.
+  Generates 2D graphs of expressions over defined regions: samples a
+  uniform grid in tiles shared through DI tile cache, refines visible
+  jumps by bisection on DI executor and decimates samples per pixel.
 */
 class PlotableExpression : public Plotable {
  public:
   /*!
     Constructor
     \param[in] expression_with_var pointer to expression with variable
+    \param[in] jit true to evaluate samples with native code
+    \param[in] executor pointer to parallel executor, nullptr to
+    sample serially on calling thread
+    \param[in] cache pointer to cache of tiles, nullptr to sample
+    every tile
+    \param[in] derivative true to plot derivative of the expression by X
+    \param[in] budget budget of refinement, unlimited by default
   */
   PlotableExpression(
-      const ComputExpressionWithVariable* const expression_with_var)
-      : expression_with_var(expression_with_var) {}
-  std::vector<std::map<double, double>> graphs(double x_lo, double x_hi,
-                                               int x_pix, double y_lo,
-                                               double y_hi,
-                                               int y_pix) const override;
+      const ComputExpressionWithVariable* const expression_with_var,
+      bool jit = false, const Executor* const executor = nullptr,
+      TileCache* const cache = nullptr, bool derivative = false,
+      PlotBudget budget = {})
+      : expression_with_var(expression_with_var),
+        jit(jit),
+        executor(executor),
+        cache(cache),
+        derivative(derivative),
+        budget(budget) {}
+  Graphs graphs(double x_lo, double x_hi, double x_pix, double y_lo,
+                double y_hi, double y_pix) const override;
+  GraphsJob plot(double x_lo, double x_hi, double x_pix, double y_lo,
+                 double y_hi, double y_pix,
+                 GraphsSink progress = nullptr) const override;
+  Generator<Graphs> plot_async(double x_lo, double x_hi, double x_pix,
+                               double y_lo, double y_hi, double y_pix,
+                               std::stop_token stop = {}) const override;
+  std::vector<Graphs> graphs(
+      const std::vector<const ComputExpressionWithVariable*>& expressions,
+      double x_lo, double x_hi, double x_pix, double y_lo, double y_hi,
+      double y_pix) const override;
 
  private:
-  std::map<double, double> recursive_plot(double x_min, double x_max,
-                                          double delta_y, double y_min,
-                                          double y_max, double y_lo,
-                                          double y_hi) const;
-  std::vector<std::map<double, double>> cut_subgraphs(
-      std::map<double, double>& source_graph, double y_lo, double y_hi) const;
-  std::string precise_dblToStr(double num) const;
+  /*!
+    \brief Struct - compiled expression of a curve and signature of its
+    tiles
+  */
+  struct Curve {
+    std::shared_ptr<const ExpressionDag> dag;
+    std::shared_ptr<const CompiledExpression> function;
+    std::shared_ptr<const CompiledExpression> program;
+    std::string expression;
+  };
+  /*!
+    \brief Struct - interval of X with values at its ends to be refined
+  */
+  struct Interval {
+    double x_min;
+    double x_max;
+    double y_min;
+    double y_max;
+    size_t tile;
+    int depth;
+  };
+  /*!
+    \brief Struct - graphs of all curves after a pass of sampling
+  */
+  struct Pass {
+    std::vector<Graphs> graphs;
+    bool final;
+  };
+  using Sample = std::pair<double, double>;
+  Curve compile(const ExpressionProgram& program) const;
+  Generator<Pass> sample(std::vector<Curve> curves,
+                         const FusedExpressionDag* fused, double x_lo,
+                         double x_hi, double x_pix, double y_lo, double y_hi,
+                         double y_pix, bool progressive,
+                         std::stop_token stop) const;
+  Generator<Graphs> passes(Curve curve, double x_lo, double x_hi,
+                           double x_pix, double y_lo, double y_hi,
+                           double y_pix, std::stop_token stop) const;
+  std::shared_ptr<const TileCache::Tile> lookup(const TileCache::Key& key,
+                                                int levels) const;
+  void seed(const TileCache::Key& key, std::span<const double> xs,
+            std::span<double> ys, std::span<unsigned> found) const;
+  bool bisect(const CompiledExpression& program, const Interval& interval,
+              double delta_y, double y_lo, double y_hi,
+              std::vector<Sample>* samples, int* depth, Interval* left,
+              Interval* right) const;
+  void refine(const CompiledExpression& program, Interval interval,
+              double delta_y, double y_lo, double y_hi,
+              const std::function<void(const Interval&)>& spawn,
+              const std::stop_token& stop, std::vector<Sample>* samples,
+              int* depth) const;
+  bool refine_within_budget(const CompiledExpression& program,
+                            const std::vector<Interval>& intervals,
+                            double delta_y, double y_lo, double y_hi,
+                            std::chrono::steady_clock::time_point start,
+                            const std::stop_token& stop,
+                            std::vector<std::vector<std::vector<Sample>>>*
+                                samples,
+                            std::vector<int>* depths) const;
+  Graphs cut_subgraphs(const std::vector<Sample>& samples, double y_lo,
+                       double y_hi) const;
+  void parallel_for(size_t count,
+                    const std::function<void(size_t)>& body) const;
   const ComputExpressionWithVariable* const expression_with_var;
+  const bool jit;
+  const Executor* const executor;
+  TileCache* const cache;
+  const bool derivative;
+  const PlotBudget budget;
 };
 
 /*!
@@ -491,10 +1483,41 @@ class Model {
     Handles Plot and AC button presses.
     \return vector of graph data (can be empty on error)
   */
-  virtual std::vector<std::map<double, double>> graphs(double x_lo, double x_hi,
-                                                       int x_pix, double y_lo,
-                                                       double y_hi,
-                                                       int y_pix) const = 0;
+  virtual Graphs graphs(double x_lo, double x_hi, double x_pix,
+                        double y_lo, double y_hi, double y_pix) const = 0;
+
+  /*!
+    Handles Plot and AC button presses off the calling thread:
+    compiles expression now, errors of compilation are stored as result.
+    \param[in] progress receiver of coarse graphs, may be empty
+    \return job generating graphs (empty on error or cancellation)
+  */
+  virtual GraphsJob graphs_job(double x_lo, double x_hi, double x_pix,
+                               double y_lo, double y_hi, double y_pix,
+                               GraphsSink progress = nullptr) const = 0;
+
+  /*!
+    Handles Plot and AC button presses as a coroutine: compiles
+    expression now, errors of compilation are stored as result, and
+    yields coarse graphs of progressive plotting as they are ready and
+    then the final graphs.
+    \param[in] stop token of cancellation, no more graphs are yielded
+    once stop is requested
+    \return generator of graphs, the last one is the final plot
+  */
+  virtual Generator<Graphs> graphs_async(double x_lo, double x_hi,
+                                         double x_pix, double y_lo,
+                                         double y_hi, double y_pix,
+                                         std::stop_token stop = {}) const = 0;
+
+  /*!
+    Handles = button press as a coroutine, solves when the result is
+    taken unless stop is requested
+    \param[in] stop token of cancellation
+    \return generator of the result or error message
+  */
+  virtual Generator<std::string> solve_async(
+      std::stop_token stop = {}) const = 0;
 };
 
 /*!
@@ -520,10 +1543,16 @@ class CalculatorModel : public Model {
   std::string expression() const override;
   std::string some_result() const override;
   void edit_variable(const std::string& var_value) const override;
-  std::vector<std::map<double, double>> graphs(double x_lo, double x_hi,
-                                               int x_pix, double y_lo,
-                                               double y_hi,
-                                               int y_pix) const override;
+  Graphs graphs(double x_lo, double x_hi, double x_pix, double y_lo,
+                double y_hi, double y_pix) const override;
+  GraphsJob graphs_job(double x_lo, double x_hi, double x_pix, double y_lo,
+                       double y_hi, double y_pix,
+                       GraphsSink progress = nullptr) const override;
+  Generator<Graphs> graphs_async(double x_lo, double x_hi, double x_pix,
+                                 double y_lo, double y_hi, double y_pix,
+                                 std::stop_token stop = {}) const override;
+  Generator<std::string> solve_async(
+      std::stop_token stop = {}) const override;
 
  private:
   std::string readble_dblToStr(double num) const;
@@ -4,12 +4,52 @@
 */
 #include <gtest/gtest.h>
 
+#include <cstring>
+
 #include "../model.h"
 
 #define TOL 1e-7
 
 namespace scn {
 
+TEST(OpcodeTable, test_0) {
+  OpcodeTable table;
+  EXPECT_EQ(table.opcode("X"), Opcode::variable);
+  EXPECT_EQ(table.opcode("("), Opcode::left_bracket);
+  EXPECT_EQ(table.opcode("mod"), Opcode::mod);
+  EXPECT_EQ(table.opcode("7"), Opcode::number);
+  EXPECT_EQ(table.opcode("E+"), Opcode::number);
+  EXPECT_EQ(table.function(Opcode::number), nullptr);
+  EXPECT_EQ(table.function(Opcode::left_bracket), nullptr);
+}
+
+TEST(OpcodeTable, test_2) {
+  const OpcodeTable& table = OpcodeTable::shared();
+  EXPECT_EQ(&table, &OpcodeTable::shared());
+  EXPECT_EQ(table.opcode("sin"), Opcode::sin);
+  EXPECT_NE(table.function(Opcode::sin), nullptr);
+}
+
+TEST(OpcodeTable, test_1) {
+  OpcodeTable table;
+  EXPECT_EQ(table.arity(Opcode::unary_minus), 1);
+  EXPECT_EQ(table.arity(Opcode::pow), 2);
+  EXPECT_EQ(table.arity(Opcode::variable), 0);
+  EXPECT_EQ(table.precedence(Opcode::sqrt), 3);
+  EXPECT_EQ(table.precedence(Opcode::div), 2);
+  EXPECT_EQ(table.precedence(Opcode::minus), 1);
+  EXPECT_EQ(table.function(Opcode::minus)->operator()(1, 3), 2);
+  EXPECT_EQ(table.function(Opcode::sqrt)->operator()(4, 0), 2);
+}
+
+TEST(Function, test_0) {
+  scn::pow power;
+  scn::unary_minus negation;
+  EXPECT_EQ(power({2.0, 3.0}), 9);
+  EXPECT_EQ(power(2.0, 3.0), 9);
+  EXPECT_EQ(negation({4.0}), -4);
+}
+
 TEST(ShuntingYardStringStack, test_0) {
   ShuntingYardStringStack stack;
   EXPECT_TRUE(stack.empty());
@@ -951,6 +991,341 @@ TEST(CalculatingDblStack, test_11) {
   }
 }
 
+TEST(ExpressionProgram, test_0) {
+  // X ^ 2 - sqrt ( 2 ) * X
+  std::vector<std::string> input = {"X", "^", "2", "-", "sqrt",
+                                    "(", "2", ")", "*", "X"};
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  for (const auto& lexema : input) infix_expr.edit(lexema);
+  CalculatingDblStack stack_calc;
+  std::string variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ExpressionProgram program(infix_expr.postfixed());
+  for (double x : {-2.5, -1.0, 0.0, 0.3, 7.0}) {
+    variable = std::to_string(x);
+    EXPECT_EQ(program.solution(std::stod(variable)),
+              comp_expression.solution());
+  }
+}
+
+TEST(ExpressionProgram, test_1) {
+  ExpressionProgram program({"2", "X", "^", "unary -", "3", "+"});
+  EXPECT_EQ(program.solution(3), -5);
+  EXPECT_EQ(program.solution(0), 2);
+}
+
+TEST(ExpressionProgram, test_2) {
+  ExpressionProgram program({});
+  EXPECT_EQ(program.solution(1), 0);
+}
+
+TEST(ExpressionProgram, test_3) {
+  try {
+    ExpressionProgram program({"X", "2", "^", "-"});
+    FAIL() << "Expected std::string exception";
+  } catch (const std::string& message) {
+    EXPECT_EQ(message, "not enough arguments");
+  }
+}
+
+TEST(ExpressionProgram, test_4) {
+  try {
+    ExpressionProgram program({"1.2.3"});
+    FAIL() << "Expected std::string exception";
+  } catch (const std::string& message) {
+    EXPECT_EQ(message, "string <1.2.3> is unconvertable to number");
+  }
+}
+
+TEST(ExpressionProgram, test_5) {
+  // sin ( X ) * X - X / 3 + X mod 2 ^ u- X
+  ExpressionProgram program({"X", "sin", "X", "*", "X", "3", "/", "-", "X",
+                             "2", "X", "unary -", "^", "mod", "+"});
+  std::vector<double> xs;
+  for (int i = 0; i != 3 * BATCH_SIZE + 17; ++i) xs.push_back(i * 0.01 - 4);
+  std::vector<double> ys(xs.size());
+  program.solutions(xs, ys);
+  for (size_t i = 0; i != xs.size(); ++i)
+    EXPECT_EQ(ys[i], program.solution(xs[i]));
+}
+
+TEST(ExpressionProgram, test_6) {
+  ExpressionProgram program({});
+  std::vector<double> xs = {1, 2};
+  std::vector<double> ys(1);
+  try {
+    program.solutions(xs, ys);
+    FAIL() << "Expected std::string exception";
+  } catch (const std::string& message) {
+    EXPECT_EQ(message, "sizes of variable values and solutions differ");
+  }
+  ys.resize(2, 1);
+  program.solutions(xs, ys);
+  EXPECT_EQ(ys, std::vector<double>({0, 0}));
+}
+
+TEST(ExpressionProgram, test_7) {
+  // sqrt ( 2 ) * X + ln ( 10 ) -> 1.414.. X * 2.302.. +
+  ExpressionProgram program({"2", "sqrt", "X", "*", "10", "ln", "+"});
+  size_t removed = 0;
+  ExpressionProgram optimized = program.optimized(&removed);
+  EXPECT_EQ(removed, 2);
+  EXPECT_EQ(optimized.tokens().size(), 5);
+  EXPECT_EQ(optimized.pool(),
+            std::vector<double>({std::sqrt(2), std::log(10)}));
+  for (double x : {-3.0, 0.0, 0.7, 1e10})
+    EXPECT_EQ(optimized.solution(x), program.solution(x));
+}
+
+TEST(ExpressionProgram, test_8) {
+  // u+ u- u- X * 1 / 1 ^ 1 - 0 * ( 2 - 1 ) -> X
+  ExpressionProgram program({"X", "unary -", "unary -", "unary +", "1", "*",
+                             "1", "/", "1", "^", "0", "-", "2", "1", "-",
+                             "*"});
+  size_t removed = 0;
+  ExpressionProgram optimized = program.optimized(&removed);
+  EXPECT_EQ(removed, 15);
+  EXPECT_EQ(optimized.tokens().size(), 1);
+  EXPECT_EQ(optimized.tokens()[0].opcode, Opcode::variable);
+}
+
+TEST(ExpressionProgram, test_9) {
+  // X + 0, 0 * X, X - u- 0 and X + u- 0 are kept for -0, NaN and Inf
+  std::vector<std::vector<std::string>> expressions = {
+      {"X", "0", "+"},
+      {"0", "X", "*"},
+      {"X", "0", "unary -", "-"},
+      {"0", "unary -", "X", "+"}};
+  std::vector<size_t> expected = {0, 0, 1, 3};
+  for (size_t i = 0; i != expressions.size(); ++i) {
+    ExpressionProgram program(expressions[i]);
+    size_t removed = 0;
+    ExpressionProgram optimized = program.optimized(&removed);
+    EXPECT_EQ(removed, expected[i]);
+    for (double x : {-0.0, 0.0, (double)NAN, (double)INFINITY}) {
+      double y = optimized.solution(x), z = program.solution(x);
+      EXPECT_EQ(std::memcmp(&y, &z, sizeof(double)), 0);
+    }
+  }
+}
+
+TEST(ExpressionDag, test_0) {
+  // sin ( X ) * sin ( X ) + cos ( X ) * sin ( X )
+  ExpressionProgram program({"X", "sin", "X", "sin", "*", "X", "cos", "X",
+                             "sin", "*", "+"});
+  ExpressionDag dag(program);
+  // X, sin, sin*sin, cos, cos*sin, +
+  EXPECT_EQ(dag.nodes().size(), 6);
+  std::vector<double> xs = {-2, -0.5, 0, 1, 3.25};
+  std::vector<double> ys(xs.size());
+  dag.solutions(xs, ys);
+  for (size_t i = 0; i != xs.size(); ++i) {
+    EXPECT_EQ(dag.solution(xs[i]), program.solution(xs[i]));
+    EXPECT_EQ(ys[i], program.solution(xs[i]));
+  }
+}
+
+TEST(ExpressionDag, test_1) {
+  // X * 2 + X * 2 ( 1 ) ( 2 ) -> only the last root 2 is kept
+  ExpressionProgram program({"X", "2", "*", "X", "2", "*", "+", "1", "2"});
+  ExpressionDag dag(program);
+  EXPECT_EQ(dag.nodes().size(), 1);
+  EXPECT_EQ(dag.solution(5), 2);
+  ExpressionDag sum(ExpressionProgram({"X", "2", "*", "X", "2", "*", "+"}));
+  EXPECT_EQ(sum.nodes().size(), 4);
+  EXPECT_EQ(sum.solution(5), 20);
+  ExpressionDag empty(ExpressionProgram({}));
+  EXPECT_TRUE(empty.nodes().empty());
+  EXPECT_EQ(empty.solution(5), 0);  EXPECT_EQ(sum.signature(),
+            ExpressionDag(ExpressionProgram({"X", "2", "*", "X", "2", "*",
+                                             "+"}))
+                .signature());
+  EXPECT_NE(sum.signature(), dag.signature());
+  EXPECT_TRUE(empty.signature().empty());
+}
+
+TEST(ExpressionDag, test_2) {
+  std::vector<std::vector<std::string>> expressions = {
+      {"X", "sin"},           {"X", "cos"},
+      {"X", "tan"},           {"X", "asin"},
+      {"X", "acos"},          {"X", "atan"},
+      {"X", "ln"},            {"X", "log"},
+      {"X", "sqrt"},          {"X", "2", "^"},
+      {"X", "3", "^"},        {"2", "X", "^"},
+      {"X", "0.5", "^"},      {"X", "-2", "^"},
+      {"1", "X", "/"},        {"X", "3", "mod"},
+      {"X", "X", "*"},        {"X", "unary -", "X", "-"},
+      {"X", "tan", "X", "/"}, {"X", "sin", "X", "cos", "+", "X", "sqrt", "*"}};
+  std::vector<std::pair<double, double>> intervals = {
+      {-0.5, 0.5}, {0.1, 1.4}, {1, 2}, {-3, -1}, {-2, 10}, {4.7, 4.8}};
+  for (const auto& postfix : expressions) {
+    ExpressionProgram program(postfix);
+    ExpressionDag dag(program);
+    for (const auto& [lo, hi] : intervals) {
+      Range range = dag.range(lo, hi);
+      Range same = program.range(lo, hi);
+      EXPECT_EQ(range.lo, same.lo);
+      EXPECT_EQ(range.hi, same.hi);
+      EXPECT_EQ(range.defined, same.defined);
+      for (int i = 0; i <= 100; ++i) {
+        double y = dag.solution(lo + (hi - lo) * i / 100);
+        if (std::isnan(y)) {
+          EXPECT_FALSE(range.defined);
+        } else {
+          EXPECT_GE(y, range.lo);
+          EXPECT_LE(y, range.hi);
+        }
+      }
+    }
+  }
+  ExpressionDag tan(ExpressionProgram({"X", "tan"}));
+  EXPECT_EQ(tan.range(1, 2).lo, -INFINITY);
+  EXPECT_EQ(tan.range(1, 2).hi, INFINITY);
+  EXPECT_EQ(tan.range(0, 1).hi, std::nextafter(std::tan(1), 2));
+  // pole between neighbouring X far from zero, where pi / 2 + k * pi
+  // drifts away from the pole
+  for (double x = 1e15; x != 1e15 + 8; x += 0.5) {
+    if (std::tan(x) > 0 && std::tan(x + 0.5) < 0) {
+      EXPECT_EQ(tan.range(x, x + 0.5).hi, INFINITY);
+    } else {
+      EXPECT_LE(tan.range(x, x + 0.5).lo, std::tan(x));
+    }
+  }
+  ExpressionDag sin(ExpressionProgram({"X", "sin"}));
+  EXPECT_EQ(sin.range(0, 3).hi, 1);
+  EXPECT_EQ(sin.range(0, 3).lo, std::nextafter(0.0, -1));
+  EXPECT_EQ(sin.range(4, 6).lo, -1);
+  ExpressionDag sqrt(ExpressionProgram({"X", "sqrt"}));
+  EXPECT_LE(sqrt.range(-1, 4).lo, 0);
+  EXPECT_EQ(sqrt.range(-1, 4).hi, std::nextafter(2.0, 3));
+  EXPECT_FALSE(sqrt.range(-1, 4).defined);
+  ExpressionDag ln(ExpressionProgram({"X", "ln"}));
+  EXPECT_TRUE(ln.range(-2, -1).empty());
+}
+
+TEST(ExpressionDag, test_3) {
+  std::vector<std::vector<std::string>> expressions = {
+      {"X", "sin"},           {"X", "cos"},
+      {"X", "tan"},           {"X", "asin"},
+      {"X", "acos"},          {"X", "atan"},
+      {"X", "ln"},            {"X", "log"},
+      {"X", "sqrt"},          {"X", "2", "^"},
+      {"X", "3", "^"},        {"2", "X", "^"},
+      {"X", "0.5", "^"},      {"X", "-2", "^"},
+      {"X", "X", "^"},        {"1", "X", "/"},
+      {"X", "3", "mod"},      {"X", "X", "*"},
+      {"X", "unary -", "X", "-"},
+      {"X", "tan", "X", "/"}, {"X", "sin", "X", "cos", "+", "X", "sqrt", "*"}};
+  const double h = 1e-6;
+  for (const auto& postfix : expressions) {
+    ExpressionProgram program(postfix);
+    ExpressionDag dag(program);
+    for (double x : {-2.5, -0.7, 0.3, 0.8, 2.5, 4.75}) {
+      Dual dual = dag.dual(x);
+      Dual same = program.dual(x);
+      double y = dag.solution(x);
+      if (std::isnan(y)) {
+        EXPECT_TRUE(std::isnan(dual.value));
+        continue;
+      }
+      EXPECT_EQ(dual.value, y);
+      EXPECT_EQ(same.value, y);
+      EXPECT_EQ(same.derivative, dual.derivative);
+      double slope = (dag.solution(x + h) - dag.solution(x - h)) / (2 * h);
+      EXPECT_NEAR(dual.derivative, slope, 1e-5 * (1 + std::abs(slope)));
+    }
+  }
+  ExpressionDag square(ExpressionProgram({"X", "2", "^"}));
+  EXPECT_EQ(square.dual(-3).derivative, -6);
+  DerivativeProgram derivative(&square);
+  std::vector<double> xs = {-1, 0, 0.5}, out(3);
+  derivative.solutions(xs, out);
+  EXPECT_EQ(out, std::vector<double>({-2, 0, 1}));
+  EXPECT_FALSE(derivative.range(0, 1).defined);
+  EXPECT_TRUE(std::isnan(derivative.dual(1).derivative));
+  EXPECT_EQ(derivative.dual(1).value, 2);
+}
+
+TEST(FusedExpressionDag, test_0) {
+  std::vector<std::vector<std::string>> expressions = {
+      {"X", "sin"},
+      {"X", "sin", "2", "^"},
+      {"X", "cos", "X", "sin", "+"},
+      {"X"},
+      {},
+      {"2", "X", "sin", "*"}};
+  std::vector<std::unique_ptr<ExpressionDag>> dags;
+  std::vector<const ExpressionDag*> pointers;
+  size_t nodes = 0;
+  for (const auto& postfix : expressions) {
+    dags.push_back(std::make_unique<ExpressionDag>(ExpressionProgram(postfix)));
+    pointers.push_back(dags.back().get());
+    nodes += dags.back()->nodes().size();
+  }
+  FusedExpressionDag fused(pointers);
+  ASSERT_EQ(fused.roots().size(), expressions.size());
+  // X, sin, 2, ^, cos, +, 0, *
+  EXPECT_EQ(fused.nodes().size(), 8);
+  EXPECT_LT(fused.nodes().size(), nodes);
+  std::vector<double> xs(1000);
+  for (size_t i = 0; i != xs.size(); ++i) xs[i] = -5 + 0.01 * i;
+  std::vector<std::vector<double>> ys(expressions.size(),
+                                      std::vector<double>(xs.size()));
+  fused.solutions(xs, std::vector<std::span<double>>(ys.begin(), ys.end()));
+  for (size_t e = 0; e != expressions.size(); ++e) {
+    std::vector<double> expected(xs.size());
+    dags[e]->solutions(xs, expected);
+    EXPECT_EQ(ys[e], expected);
+  }
+  std::vector<double> wrong(1);
+  EXPECT_THROW(fused.solutions(xs, {wrong}), std::string);
+}
+
+TEST(NativeProgram, test_0) {
+  std::vector<std::vector<std::string>> expressions = {
+      {},
+      {"X"},
+      {"3.5"},
+      {"X", "unary -", "unary +"},
+      {"X", "X", "*", "2", "X", "*", "-", "1", "+", "X", "/"},
+      {"X", "sin", "X", "cos", "*", "X", "tan", "+", "X", "atan", "-"},
+      {"X", "asin", "X", "acos", "+", "X", "ln", "X", "log", "/", "-"},
+      {"X", "sqrt", "2", "X", "^", "mod", "X", "3", "^", "unary -", "+"},
+      {"1", "2", "3", "4", "5", "6", "7", "8", "9", "+", "+", "+", "+", "+",
+       "+", "+", "+", "X", "*"},
+      {"X", "0", "/", "X", "X", "-", "sqrt", "+"},
+  };
+  std::vector<double> xs = {-1e300, -3.7,      -1, -0.5, -0.0, 0.0, 1e-310,
+                            0.25,   1,         2,  3.7,  1e300,
+                            INFINITY, -INFINITY, NAN, -NAN};
+  for (const auto& postfix : expressions) {
+    ExpressionProgram program(postfix);
+    ExpressionDag dag(program);
+    NativeProgram native(&dag);
+#if defined(__x86_64__) && defined(__unix__)
+    EXPECT_TRUE(native.native());
+#endif
+    std::vector<double> ys(xs.size());
+    native.solutions(xs, ys);
+    for (size_t i = 0; i != xs.size(); ++i) {
+      CalculatingDblStack stack_calc;
+      double expected = 0;
+      for (const auto& token : postfix) {
+        if (token == "X")
+          stack_calc.push(xs[i]);
+        else
+          stack_calc.push(token);
+        expected = stack_calc.top();
+      }
+      double result = native.solution(xs[i]);
+      EXPECT_EQ(std::memcmp(&result, &expected, sizeof(double)), 0);
+      EXPECT_EQ(std::memcmp(&ys[i], &expected, sizeof(double)), 0);
+    }
+  }
+}
+
 TEST(ComputableStringExpression, test_0) {
   ShuntingYardStringStack oper_stack;
   PostfixStringExpression infix_expr(&oper_stack);
@@ -1034,6 +1409,65 @@ TEST(VariableCalculator, test_0) {
   EXPECT_EQ(var_calc.solution(), 2);
 }
 
+TEST(VariableCalculator, test_1) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  std::string variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  var_calc.edit("X");
+  var_calc.edit("*");
+  var_calc.edit("X");
+  var_calc.edit("-");
+  var_calc.edit("1");
+  std::vector<double> xs = {-1, 0, 0.5, 3};
+  std::vector<double> ys(xs.size());
+  var_calc.solutions(xs, ys);
+  EXPECT_EQ(ys, std::vector<double>({0, -1, -0.75, 8}));
+}
+
+TEST(VariableCalculator, test_2) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  var_calc.edit("2");
+  var_calc.edit("^");
+  var_calc.edit("unary -");
+  var_calc.edit("X");
+  var_calc.edit_variable("1");
+  EXPECT_EQ(variable.value, 1);
+  EXPECT_EQ(var_calc.solution(), 0.5);
+  var_calc.edit_variable(-2.0);
+  EXPECT_EQ(var_calc.solution(), 4);
+  var_calc.edit_variable("1,5");
+  try {
+    var_calc.solution();
+    FAIL() << "Expected std::string exception";
+  } catch (const std::string& message) {
+    EXPECT_EQ(message, "string <1,5> is unconvertable to number");
+  }
+}
+
+TEST(VariableCalculator, test_3) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  std::string variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  var_calc.edit("X");
+  var_calc.edit_variable(0.1);
+  EXPECT_EQ(variable, "0.1");
+  EXPECT_EQ(var_calc.solution(), 0.1);
+}
+
 TEST(GraphVarCalculator, test_4) {
   ShuntingYardStringStack oper_stack;
   PostfixStringExpression infix_expr(&oper_stack);
@@ -1047,14 +1481,590 @@ TEST(GraphVarCalculator, test_4) {
   var_calc.edit("^");
   var_calc.edit("2");
   EXPECT_EQ(var_calc.string(), "X^2");
-  std::vector<std::map<double, double>> graph =
-      graph_calc.graphs(-2, 2, 2, -2, 4, 1);
+  Graphs graph = graph_calc.graphs(-2, 2, 2, -2, 4, 1);
   std::map<double, double> test_map = {
       {-2, 4}, {-1, 1}, {0, 0}, {1, 1}, {2, 4}};
   for (const auto& [key, value] : test_map)
     EXPECT_EQ(graph.back().at(key), value);
 }
 
+TEST(Graphs, test_0) {
+  Graphs graphs;
+  EXPECT_TRUE(graphs.empty());
+  graphs.split();
+  EXPECT_TRUE(graphs.empty());
+  graphs.push_back(0, 1);
+  graphs.push_back(1, 2);
+  graphs.split();
+  graphs.split();
+  graphs.push_back(3, 4);
+  graphs.split();
+  EXPECT_EQ(graphs.size(), 2);
+  EXPECT_EQ(graphs.samples(), 3);
+  EXPECT_EQ(graphs[0].size(), 2);
+  EXPECT_EQ(graphs[0].at(1), 2);
+  EXPECT_EQ(graphs.back().size(), 1);
+  EXPECT_EQ(graphs.back().x[0], 3);
+  EXPECT_EQ(graphs.back().y[0], 4);
+  EXPECT_THROW(graphs[0].at(0.5), std::out_of_range);
+  EXPECT_THROW(graphs[0].at(3), std::out_of_range);
+}
+
+TEST(Graphs, test_1) {
+  Graphs graphs;
+  for (int i = 0; i != 100; ++i) graphs.push_back(1 + i / 1000.0, i % 7);
+  graphs.push_back(2.5, 1);
+  graphs.split();
+  graphs.push_back(3.25, 5);
+  graphs.split();
+  Graphs decimated = graphs.decimated(0, 1);
+  EXPECT_EQ(decimated.size(), 2);
+  EXPECT_EQ(decimated.samples(), 5);
+  EXPECT_EQ(decimated.dropped(), 97);
+  std::vector<double> x(decimated[0].x.begin(), decimated[0].x.end());
+  std::vector<double> y(decimated[0].y.begin(), decimated[0].y.end());
+  EXPECT_EQ(x, std::vector<double>({1, 1.006, 1.099, 2.5}));
+  EXPECT_EQ(y, std::vector<double>({0, 6, 1, 1}));
+  EXPECT_EQ(decimated.back().at(3.25), 5);
+  EXPECT_EQ(decimated.decimated(0, 1).samples(), 5);
+  EXPECT_EQ(decimated.decimated(0, 1).dropped(), 97);
+
+  Graphs flat;
+  for (double x : {0.1, 0.2, 0.3, 1.1, 1.2}) flat.push_back(x, 2);
+  flat.split();
+  for (int k = 1; k != 5; ++k)
+    flat.push_back(2 + k / 10.0, k == 1 || k == 4 ? 1 : 3);
+  flat.split();
+  decimated = flat.decimated(0, 1);
+  x.assign(decimated[0].x.begin(), decimated[0].x.end());
+  EXPECT_EQ(x, std::vector<double>({0.1, 0.3, 1.1, 1.2}));
+  x.assign(decimated[1].x.begin(), decimated[1].x.end());
+  y.assign(decimated[1].y.begin(), decimated[1].y.end());
+  EXPECT_EQ(x, std::vector<double>({2 + 1 / 10.0, 2 + 2 / 10.0,
+                                    2 + 4 / 10.0}));
+  EXPECT_EQ(y, std::vector<double>({1, 3, 1}));
+}
+
+TEST(TileCache, test_0) {
+  auto tile = std::make_shared<const TileCache::Tile>(
+      TileCache::Tile(100, {1.0, 2.0}));
+  TileCache probe;
+  probe.insert({"1", false, 0, 10, -1, 1, 10, {}}, tile);
+  size_t footprint = probe.memory();
+  EXPECT_GT(footprint, 100 * sizeof(std::pair<double, double>));
+  TileCache cache(3 * footprint);
+  for (int64_t t = 0; t != 3; ++t)
+    cache.insert({"1", false, t, 10, -1, 1, 10, {}}, tile);
+  EXPECT_EQ(cache.size(), 3);
+  EXPECT_EQ(cache.find({"1", false, 0, 10, -1, 1, 10, {}}), tile);
+  EXPECT_EQ(cache.find({"2", false, 0, 10, -1, 1, 10, {}}), nullptr);
+  EXPECT_EQ(cache.find({"1", false, 0, 11, -1, 1, 10, {}}), nullptr);
+  cache.insert({"1", false, 3, 10, -1, 1, 10, {}}, tile);
+  EXPECT_EQ(cache.size(), 3);
+  EXPECT_EQ(cache.memory(), 3 * footprint);
+  EXPECT_EQ(cache.find({"1", false, 1, 10, -1, 1, 10, {}}), nullptr);
+  EXPECT_NE(cache.find({"1", false, 0, 10, -1, 1, 10, {}}), nullptr);
+  cache.insert({"1", false, 0, 10, -1, 1, 10, {}}, tile);
+  EXPECT_EQ(cache.size(), 3);
+  // every part of the key is compared, not only its hash
+  EXPECT_EQ(cache.find({"1", true, 0, 10, -1, 1, 10, {}}), nullptr);
+  EXPECT_EQ(cache.find({"1", false, 0, 10, -1, 1, 10, {0, {}, 3}}), nullptr);
+  EXPECT_EQ(cache.find({"1", false, 0, 10, -1, 1, 10, {100}}), nullptr);
+}
+
+TEST(SampleRing, test_0) {
+  SampleRing ring(3);
+  SampleBlock block = {};
+  for (size_t i = 0; i != 4; ++i) {
+    block.graph = i;
+    EXPECT_TRUE(ring.push(block));
+  }
+  EXPECT_FALSE(ring.push(block));
+  for (size_t i = 0; i != 4; ++i) {
+    EXPECT_TRUE(ring.pop(&block));
+    EXPECT_EQ(block.graph, i);
+  }
+  EXPECT_FALSE(ring.pop(&block));
+  Graphs graphs;
+  for (int i = 0; i != 2 * SAMPLE_BLOCK_SIZE; ++i) graphs.push_back(i, -i);
+  graphs.split();
+  for (size_t i = 0; i != 4; ++i) EXPECT_TRUE(ring.push(block));
+  std::stop_source source;
+  source.request_stop();
+  EXPECT_FALSE(ring.write(graphs, 0, source.get_token()));
+  for (size_t i = 0; i != 4; ++i) EXPECT_TRUE(ring.pop(&block));
+  EXPECT_FALSE(ring.pop(&block));
+  EXPECT_TRUE(ring.write(Graphs(), 7, source.get_token()));
+  EXPECT_TRUE(ring.pop(&block));
+  EXPECT_EQ(block.frame, 7);
+  EXPECT_EQ(block.graphs, 0);
+  EXPECT_EQ(block.size, 0);
+  EXPECT_EQ(ring.front(), nullptr);
+  SampleBlock* slot = ring.reserve();
+  ASSERT_NE(slot, nullptr);
+  slot->graph = 5;
+  EXPECT_EQ(ring.front(), nullptr);
+  ring.commit();
+  ASSERT_EQ(ring.front(), slot);
+  EXPECT_EQ(ring.front()->graph, 5);
+  ring.release();
+  EXPECT_EQ(ring.front(), nullptr);
+}
+
+TEST(SampleRing, test_1) {
+  std::vector<Graphs> frames(3);
+  for (size_t f = 0; f != frames.size(); ++f) {
+    for (int g = 0; g != 3; ++g) {
+      for (int i = 0; i <= 1000 * g + 7 * (int)f; ++i)
+        frames[f].push_back(i, g * i);
+      frames[f].split();
+    }
+  }
+  SampleRing ring(2);
+  std::thread producer([&] {
+    for (size_t f = 0; f != frames.size(); ++f)
+      EXPECT_TRUE(ring.write(frames[f], f, {}));
+  });
+  std::vector<std::vector<std::vector<double>>> xs(frames.size()),
+      ys(frames.size());
+  SampleBlock block;
+  size_t blocks = 0;
+  while (blocks != 3 * 7) {
+    if (!ring.pop(&block)) continue;
+    ++blocks;
+    ASSERT_LT(block.frame, frames.size());
+    xs[block.frame].resize(block.graphs);
+    ys[block.frame].resize(block.graphs);
+    xs[block.frame][block.graph].insert(xs[block.frame][block.graph].end(),
+                                        block.x.begin(),
+                                        block.x.begin() + block.size);
+    ys[block.frame][block.graph].insert(ys[block.frame][block.graph].end(),
+                                        block.y.begin(),
+                                        block.y.begin() + block.size);
+  }
+  producer.join();
+  EXPECT_FALSE(ring.pop(&block));
+  for (size_t f = 0; f != frames.size(); ++f) {
+    ASSERT_EQ(xs[f].size(), frames[f].size());
+    for (size_t g = 0; g != frames[f].size(); ++g) {
+      EXPECT_TRUE(std::equal(xs[f][g].begin(), xs[f][g].end(),
+                             frames[f][g].x.begin(), frames[f][g].x.end()));
+      EXPECT_TRUE(std::equal(ys[f][g].begin(), ys[f][g].end(),
+                             frames[f][g].y.begin(), frames[f][g].y.end()));
+    }
+  }
+}
+
+TEST(SampleRing, test_2) {
+  Graphs graphs;
+  for (int i = 0; i != 4 * SAMPLE_BLOCK_SIZE; ++i) graphs.push_back(i, i);
+  graphs.split();
+  SampleRing ring(2);
+  std::stop_source source;
+  std::thread producer(
+      [&] { EXPECT_FALSE(ring.write(graphs, 0, source.get_token())); });
+  SampleBlock block;
+  while (!ring.pop(&block)) {
+  }
+  EXPECT_EQ(block.x[0], 0);
+  source.request_stop();
+  producer.join();
+}
+
+TEST(ThreadPool, test_0) {
+  ThreadPool pool(4);
+  EXPECT_EQ(pool.concurrency(), 4);
+  std::vector<int> counts(1000);
+  pool.parallel_for(counts.size(), [&](size_t i) { counts[i]++; });
+  EXPECT_EQ(counts, std::vector<int>(1000, 1));
+  pool.parallel_for(0, [&](size_t i) { counts[i]++; });
+  try {
+    pool.parallel_for(10, [](size_t i) {
+      if (i == 7) throw std::string("job 7 failed");
+    });
+    FAIL() << "Expected std::string exception";
+  } catch (const std::string& message) {
+    EXPECT_EQ(message, "job 7 failed");
+  }
+}
+
+TEST(ThreadPool, test_1) {
+  ThreadPool pool(4);
+  std::vector<std::vector<int>> leaves(pool.concurrency());
+  std::function<void(int, size_t)> split = [&](int depth, size_t worker) {
+    EXPECT_LT(worker, pool.concurrency());
+    if (depth == 0) {
+      leaves[worker].push_back(1);
+      return;
+    }
+    pool.spawn(worker, [&, depth](size_t w) { split(depth - 1, w); });
+    split(depth - 1, worker);
+  };
+  std::vector<Executor::Task> roots;
+  for (int i = 0; i != 3; ++i)
+    roots.push_back([&](size_t worker) { split(10, worker); });
+  pool.run(std::move(roots));
+  size_t total = 0;
+  for (const auto& worker_leaves : leaves) total += worker_leaves.size();
+  EXPECT_EQ(total, 3 * 1024);
+}
+
+TEST(GraphVarCalculator, test_5) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"tan", "X", "/", "X"}) var_calc.edit(lexema);
+  PlotableExpression serial(&var_calc);
+  ThreadPool pool(3);
+  PlotableExpression parallel(&var_calc, true, &pool);
+  auto expected = serial.graphs(-30, 30, 40, -5, 5, 40);
+  EXPECT_GT(expected.size(), 1);
+  EXPECT_EQ(parallel.graphs(-30, 30, 40, -5, 5, 40), expected);
+}
+
+TEST(GraphVarCalculator, test_6) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"tan", "X"}) var_calc.edit(lexema);
+  ThreadPool pool(3);
+  PlotableExpression graph_calc(&var_calc, false, &pool);
+  GraphsJob job = graph_calc.plot(-30, 30, 40, -5, 5, 40);
+  var_calc.clear();
+  std::stop_source source;
+  std::thread worker([&] {
+    Graphs graphs = job(source.get_token());
+    EXPECT_TRUE(graphs.empty() || graphs.size() > 1);
+  });
+  source.request_stop();
+  worker.join();
+  EXPECT_TRUE(job(source.get_token()).empty());
+  EXPECT_GT(job(std::stop_token()).size(), 1);
+}
+
+TEST(GraphVarCalculator, test_7) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"tan", "X", "/", "X"}) var_calc.edit(lexema);
+  ThreadPool pool(3);
+  PlotableExpression graph_calc(&var_calc, true, &pool);
+  std::vector<size_t> coarse;
+  GraphsJob job =
+      graph_calc.plot(-30, 30, 40, -5, 5, 40, [&](const Graphs& graphs) {
+        coarse.push_back(graphs.samples());
+      });
+  EXPECT_EQ(job(std::stop_token()), graph_calc.graphs(-30, 30, 40, -5, 5, 40));
+  ASSERT_EQ(coarse.size(), 2);
+  EXPECT_GT(coarse[0], 0);
+  EXPECT_LT(coarse[0], coarse[1]);
+  // coroutine samples on the thread resuming it, passes are the same
+  std::vector<size_t> passes;
+  for (const Graphs& graphs :
+       graph_calc.plot_async(-30, 30, 40, -5, 5, 40)) {
+    passes.push_back(graphs.samples());
+  }
+  coarse.push_back(graph_calc.graphs(-30, 30, 40, -5, 5, 40).samples());
+  EXPECT_EQ(passes, coarse);
+}
+
+TEST(GraphVarCalculator, test_8) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"tan", "X", "/", "X"}) var_calc.edit(lexema);
+  ThreadPool pool(3);
+  TileCache cache;
+  PlotableExpression uncached(&var_calc, true, &pool);
+  PlotableExpression cached(&var_calc, true, &pool, &cache);
+  EXPECT_EQ(cached.graphs(-30, 30, 40, -5, 5, 40),
+            uncached.graphs(-30, 30, 40, -5, 5, 40));
+  size_t tiles = cache.size();
+  EXPECT_GT(tiles, 1);
+  EXPECT_EQ(cached.graphs(-30, 30, 40, -5, 5, 40),
+            uncached.graphs(-30, 30, 40, -5, 5, 40));
+  EXPECT_EQ(cache.size(), tiles);
+  EXPECT_EQ(cached.graphs(-25.3, 20.1, 40, -5, 5, 40),
+            uncached.graphs(-25.3, 20.1, 40, -5, 5, 40));
+  EXPECT_EQ(cache.size(), tiles);
+  EXPECT_EQ(cached.graphs(10, 90, 40, -5, 5, 40),
+            uncached.graphs(10, 90, 40, -5, 5, 40));
+  EXPECT_GT(cache.size(), tiles);
+  tiles = cache.size();
+  EXPECT_EQ(cached.graphs(-20, 20, 50, -4, 6, 48),
+            uncached.graphs(-20, 20, 50, -4, 6, 48));
+  EXPECT_EQ(cache.size(), tiles);
+  var_calc.edit("+");
+  var_calc.edit("1");
+  EXPECT_EQ(cached.graphs(-30, 30, 40, -5, 5, 40),
+            uncached.graphs(-30, 30, 40, -5, 5, 40));
+}
+
+TEST(GraphVarCalculator, test_9) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"tan", "X"}) var_calc.edit(lexema);
+  TileCache cache;
+  PlotableExpression uncached(&var_calc);
+  PlotableExpression cached(&var_calc, false, nullptr, &cache);
+  cached.graphs(-60, 60, 40, -5, 5, 10);
+  EXPECT_EQ(cache.size(), 8);
+  Graphs zoomed_out = cached.graphs(-60, 60, 20, -5, 5, 10);
+  EXPECT_EQ(cache.size(), 12);
+  Graphs sampled = uncached.graphs(-60, 60, 20, -5, 5, 10);
+  ASSERT_EQ(zoomed_out.size(), sampled.size());
+  for (size_t i = 0; i != sampled.size(); ++i) {
+    EXPECT_NEAR(zoomed_out[i].x.front(), sampled[i].x.front(), 0.05);
+    EXPECT_NEAR(zoomed_out[i].x.back(), sampled[i].x.back(), 0.05);
+  }
+  EXPECT_LE(zoomed_out.samples(), 4 * 20 * 120 + 4);
+  for (size_t i = 1; i + 1 < sampled.size(); ++i) {
+    EXPECT_LT(sampled[i].y.front(), -5);
+    EXPECT_GT(sampled[i].y.back(), 5);
+  }
+  cached.graphs(-60, 60, 10, -5, 5, 10);
+  EXPECT_EQ(cache.size(), 14);
+
+  var_calc.clear();
+  for (const auto& lexema :
+       {"1", "0", "0", "*", "sqrt", "(", "X", "-", "8", "/", "2", "5", ")"})
+    var_calc.edit(lexema);
+  cached.graphs(-70, 70, 40, -10, 150, 10);
+  zoomed_out = cached.graphs(-2, 2, 10, -10, 150, 10);
+  sampled = uncached.graphs(-2, 2, 10, -10, 150, 10);
+  ASSERT_EQ(zoomed_out.size(), sampled.size());
+  ASSERT_EQ(sampled.size(), 1);
+  // first finite sample of fine tiles at the edge of the domain is kept
+  EXPECT_EQ(zoomed_out[0].x.front(), 21 / 64.0);
+  EXPECT_NEAR(zoomed_out[0].x.back(), sampled[0].x.back(), 0.1);
+  EXPECT_TRUE(std::is_sorted(zoomed_out[0].x.begin(), zoomed_out[0].x.end()));
+}
+
+TEST(GraphVarCalculator, test_10) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"X", "^", "3", "-", "X"}) var_calc.edit(lexema);
+  TileCache cache;
+  PlotableExpression function(&var_calc, true, nullptr, &cache);
+  PlotableExpression derivative(&var_calc, true, nullptr, &cache, true);
+  Graphs graphs = function.graphs(-2, 2, 100, -10, 10, 100);
+  Graphs slopes = derivative.graphs(-2, 2, 100, -10, 10, 100);
+  ASSERT_EQ(slopes.size(), 1);
+  ASSERT_GT(slopes[0].size(), 100);
+  for (size_t i = 0; i != slopes[0].size(); ++i) {
+    double x = slopes[0].x[i];
+    EXPECT_NEAR(slopes[0].y[i], 3 * x * x - 1, 1e-9);
+  }
+  ASSERT_EQ(graphs.size(), 1);
+  EXPECT_NE(graphs[0].y[0], slopes[0].y[0]);
+  EXPECT_EQ(cache.size(), 4);
+}
+
+TEST(GraphVarCalculator, test_11) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"sin", "(", "1", "/", "X", ")"})
+    var_calc.edit(lexema);
+  PlotableExpression exact(&var_calc);
+  PlotableExpression enough(&var_calc, false, nullptr, nullptr, false,
+                            {1 << 30, std::chrono::milliseconds(0)});
+  TileCache cache;
+  PlotableExpression bounded(&var_calc, false, nullptr, &cache, false,
+                             {100, std::chrono::milliseconds(0)});
+  Graphs graphs = exact.graphs(-1, 1, 200, -2, 2, 200);
+  EXPECT_FALSE(graphs.truncated());
+  EXPECT_GT(graphs.samples() + graphs.dropped(), 2 * 200 + 100);
+  EXPECT_EQ(enough.graphs(-1, 1, 200, -2, 2, 200), graphs);
+  Graphs truncated = bounded.graphs(-1, 1, 200, -2, 2, 200);
+  EXPECT_TRUE(truncated.truncated());
+  EXPECT_FALSE(truncated.empty());
+  EXPECT_LT(truncated.samples() + truncated.dropped(),
+            graphs.samples() + graphs.dropped());
+  EXPECT_EQ(cache.size(), 0);
+  ThreadPool pool(4);
+  PlotableExpression parallel_enough(&var_calc, false, &pool, nullptr, false,
+                                     {1 << 30, std::chrono::milliseconds(0)});
+  PlotableExpression parallel_bounded(&var_calc, false, &pool, nullptr, false,
+                                      {100, std::chrono::milliseconds(0)});
+  EXPECT_EQ(parallel_enough.graphs(-1, 1, 200, -2, 2, 200), graphs);
+  truncated = parallel_bounded.graphs(-1, 1, 200, -2, 2, 200);
+  EXPECT_TRUE(truncated.truncated());
+  EXPECT_GE(truncated.refinement().samples, 100);
+  EXPECT_LT(truncated.refinement().samples, 100 + 4);
+}
+
+TEST(GraphVarCalculator, test_12) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"sin", "(", "1", "/", "X", ")"})
+    var_calc.edit(lexema);
+  ThreadPool pool(3);
+  PlotableExpression deep(&var_calc, false, nullptr, nullptr, false,
+                          {0, std::chrono::milliseconds(0), 100000});
+  PlotableExpression parallel(&var_calc, false, &pool);
+  PlotableExpression shallow(&var_calc, false, nullptr, nullptr, false,
+                             {0, std::chrono::milliseconds(0), 2});
+  Graphs graphs = deep.graphs(-1, 1, 200, -2, 2, 200);
+  RefineStats stats = graphs.refinement();
+  EXPECT_GT(stats.samples, 100);
+  EXPECT_GT(stats.depth, 2);
+  EXPECT_LT(stats.depth, 1100);
+  Graphs limited = parallel.graphs(-1, 1, 200, -2, 2, 200);
+  EXPECT_LE(limited.refinement().depth, REFINE_DEPTH);
+  EXPECT_LE(limited.refinement().samples, stats.samples);
+  RefineStats few = shallow.graphs(-1, 1, 200, -2, 2, 200).refinement();
+  EXPECT_EQ(few.depth, 2);
+  EXPECT_LT(few.samples, limited.refinement().samples);
+}
+
+TEST(GraphVarCalculator, test_13) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"sin", "X"}) var_calc.edit(lexema);
+  PlotableExpression graph_calc(&var_calc);
+  // 500 pixels over 10000 units, grid step is 16 units, less than
+  // a pixel of Y over the screen, so grid is not refined, the first
+  // and the last points lie beyond the ends of the screen
+  Graphs graphs = graph_calc.graphs(-5000, 5000, 0.05, -2, 2, 0.1);
+  ASSERT_EQ(graphs.size(), 1);
+  EXPECT_EQ(graphs[0].x.front(), -5008);
+  EXPECT_EQ(graphs[0].x.back(), 5008);
+  EXPECT_LE(graphs.samples(), 4 * 501 + 4);
+  for (double x : graphs[0].x) EXPECT_EQ(std::fmod(x, 16), 0);
+  // 2000 pixels, grid step is 512 units
+  EXPECT_EQ(graph_calc.graphs(-1e6, 1e6, 1e-3, -1e4, 1e4, 0.01).samples(),
+            2 * 1954 + 1);
+  // ends of the screen on the grid are the first and the last points
+  graphs = graph_calc.graphs(-4992, 4992, 0.05, -2, 2, 0.1);
+  EXPECT_EQ(graphs[0].x.front(), -4992);
+  EXPECT_EQ(graphs[0].x.back(), 4992);
+  EXPECT_TRUE(graph_calc.graphs(-5000, 5000, 0, -2, 2, 100).empty());
+  EXPECT_TRUE(graph_calc.graphs(-5, 5, 10, -2, 2, -1).empty());
+  EXPECT_TRUE(graph_calc.graphs(-5, 5, NAN, -2, 2, 100).empty());
+}
+
+TEST(GraphVarCalculator, test_14) {
+  std::vector<std::vector<std::string>> inputs = {
+      {"sin", "X"}, {"sin", "X", "^", "2"}, {"tan", "X"}, {"X"}};
+  std::vector<std::unique_ptr<ShuntingYardStringStack>> oper_stacks;
+  std::vector<std::unique_ptr<PostfixStringExpression>> infix_exprs;
+  std::vector<std::unique_ptr<CalculatingDblStack>> stack_calcs;
+  std::vector<std::unique_ptr<Variable>> variables;
+  std::vector<std::unique_ptr<CalculatingStack_with_variable>> stacks_w_X;
+  std::vector<std::unique_ptr<ComputableStringExpression>> comp_expressions;
+  std::vector<std::unique_ptr<ComputStrExpressionWithVariable>> var_calcs;
+  std::vector<const ComputExpressionWithVariable*> expressions;
+  for (const auto& input : inputs) {
+    oper_stacks.push_back(std::make_unique<ShuntingYardStringStack>());
+    infix_exprs.push_back(
+        std::make_unique<PostfixStringExpression>(oper_stacks.back().get()));
+    stack_calcs.push_back(std::make_unique<CalculatingDblStack>());
+    variables.push_back(std::make_unique<Variable>());
+    stacks_w_X.push_back(std::make_unique<CalculatingStack_with_variable>(
+        stack_calcs.back().get(), variables.back().get()));
+    comp_expressions.push_back(std::make_unique<ComputableStringExpression>(
+        infix_exprs.back().get(), stacks_w_X.back().get()));
+    var_calcs.push_back(std::make_unique<ComputStrExpressionWithVariable>(
+        comp_expressions.back().get(), variables.back().get()));
+    for (const auto& lexema : input) var_calcs.back()->edit(lexema);
+    expressions.push_back(var_calcs.back().get());
+  }
+  ThreadPool pool(3);
+  TileCache cache;
+  PlotableExpression fused(expressions[0], true, &pool, &cache);
+  // the second expression is cached before, the rest is sampled together
+  PlotableExpression(expressions[1], false, nullptr, &cache)
+      .graphs(-30, 30, 40, -5, 5, 40);
+  std::vector<Graphs> graphs =
+      fused.graphs(expressions, -30, 30, 40, -5, 5, 40);
+  ASSERT_EQ(graphs.size(), inputs.size());
+  for (size_t e = 0; e != inputs.size(); ++e) {
+    PlotableExpression single(expressions[e]);
+    EXPECT_EQ(graphs[e], single.graphs(-30, 30, 40, -5, 5, 40));
+    EXPECT_FALSE(graphs[e].empty());
+  }
+  EXPECT_EQ(cache.size(), 4 * 4);
+  EXPECT_EQ(fused.graphs(expressions, -30, 30, 40, -5, 5, 40), graphs);
+  PlotableExpression derivative(expressions[0], false, nullptr, nullptr, true);
+  std::vector<Graphs> slopes =
+      derivative.graphs(expressions, -3, 3, 40, -5, 5, 40);
+  EXPECT_EQ(slopes[3][0].y.front(), 1);
+  EXPECT_TRUE(fused.graphs({}, -30, 30, 40, -5, 5, 40).empty());
+}
+
+TEST(GraphVarCalculator, test_15) {
+  ShuntingYardStringStack oper_stack;
+  PostfixStringExpression infix_expr(&oper_stack);
+  CalculatingDblStack stack_calc;
+  Variable variable;
+  CalculatingStack_with_variable stack_w_X(&stack_calc, &variable);
+  ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  ComputStrExpressionWithVariable var_calc(&comp_expression, &variable);
+  for (const auto& lexema : {"sin", "X"}) var_calc.edit(lexema);
+  TileCache cache;
+  PlotableExpression uncached(&var_calc);
+  PlotableExpression cached(&var_calc, false, nullptr, &cache);
+  // zoom-in by two octaves in X and in both axes samples only new points
+  cached.graphs(-8, 8, 10, -2, 2, 10);
+  EXPECT_EQ(cached.graphs(-2, 2, 40, -2, 2, 10),
+            uncached.graphs(-2, 2, 40, -2, 2, 10));
+  EXPECT_EQ(cached.graphs(-2, 2, 40, -0.5, 0.5, 40),
+            uncached.graphs(-2, 2, 40, -0.5, 0.5, 40));
+  // value of a coarse tile is taken instead of evaluation
+  TileCache seeds;
+  PlotableExpression seeded(&var_calc, false, nullptr, &seeds);
+  std::string expression =
+      ExpressionDag(var_calc.program().optimized()).signature();
+  seeds.insert({expression, false, 0, 16, -4, 4, 16, {}},
+               std::make_shared<const TileCache::Tile>(
+                   TileCache::Tile{{0.0, 0.0}, {0.25, 0.5}}));
+  Graphs graphs = seeded.graphs(0, 1, 64, -2, 2, 16);
+  ASSERT_EQ(graphs.size(), 1);
+  EXPECT_EQ(graphs[0].at(0.25), 0.5);
+  EXPECT_EQ(graphs[0].at(0.5), std::sin(0.5));
+}
+
 TEST(CalculatorModel, test_0) {
   std::string variable;
   // Calculating Stack
@@ -1254,6 +2264,14 @@ TEST(CalculatorModel, test_4) {
       {-2, 4}, {-1, 1}, {0, 0}, {1, 1}, {2, 4}};
   for (const auto& [key, value] : test_map)
     EXPECT_EQ(model.graphs(-2, 2, 2, -2, 4, 1).back().at(key), value);
+
+  GraphsJob job = model.graphs_job(-2, 2, 2, -2, 4, 1);
+  model.modify("AC");
+  EXPECT_EQ(job(std::stop_token()).back().at(2), 4);
+  std::stop_source source;
+  source.request_stop();
+  EXPECT_TRUE(job(source.get_token()).empty());
+  EXPECT_TRUE(model.graphs_job(-2, 2, 2, -2, 4, 1)(std::stop_token()).empty());
 }
 
 TEST(CalculatorModel, test_5) {
@@ -1291,6 +2309,70 @@ TEST(CalculatorModel, test_5) {
   EXPECT_EQ(model.some_result(), "not enough arguments");
 }
 
+TEST(CalculatorModel, test_6) {
+  std::string variable;
+  // Calculating Stack
+  scn::CalculatingDblStack stack_simple;
+  // Calculating Stack
+  scn::CalculatingStack_with_variable stack_w_X(&stack_simple, &variable);
+  // Shunting Yard Algorithm Stack
+  scn::ShuntingYardStringStack oper_stack;
+  // Postfixable Expression
+  scn::PostfixStringExpression infix_expr(&oper_stack);
+  // Computable Expression
+  scn::ComputableStringExpression comp_expression(&infix_expr, &stack_w_X);
+  // Computable Expression With Variable
+  scn::ComputStrExpressionWithVariable comp_expression_x(&comp_expression,
+                                                         &variable);
+  // ExpressionGraphPlot
+  TileCache cache;
+  scn::PlotableExpression graph_plot_expression(&comp_expression_x, false,
+                                                nullptr, &cache);
+  scn::CalculatorModel model(&comp_expression_x, &graph_plot_expression);
+
+  model.modify("X");
+
+  model.modify("^");
+
+  model.modify("2");
+
+  Generator<Graphs> passes = model.graphs_async(-2, 2, 32, -2, 4, 32);
+  model.modify("AC");
+  std::vector<Graphs> graphs;
+  for (const Graphs& pass : passes) graphs.push_back(pass);
+  ASSERT_EQ(graphs.size(), 3);
+  EXPECT_LT(graphs[0].samples(), graphs[1].samples());
+  EXPECT_LT(graphs[1].samples(), graphs[2].samples());
+  EXPECT_EQ(graphs[2].back().at(2), 4);
+  EXPECT_FALSE(passes.next());
+
+  model.modify("X");
+  model.modify("^");
+  model.modify("2");
+  // only tiles of the final graphs are cached
+  size_t tiles = cache.size();
+  EXPECT_EQ(graphs[2], model.graphs(-2, 2, 32, -2, 4, 32));
+  EXPECT_EQ(cache.size(), tiles);
+  std::stop_source source;
+  passes = model.graphs_async(-2, 2, 32, -2, 4, 32, source.get_token());
+  EXPECT_TRUE(passes.next());
+  source.request_stop();
+  EXPECT_FALSE(passes.next());
+
+  model.edit_variable("3");
+  Generator<std::string> solution = model.solve_async();
+  EXPECT_EQ(model.some_result(), "");
+  EXPECT_EQ(*solution.begin(), "9");
+  EXPECT_EQ(model.some_result(), "9");
+  EXPECT_TRUE(model.solve_async(source.get_token()).begin() ==
+              std::default_sentinel);
+
+  model.modify("-");
+  for (const Graphs& pass : model.graphs_async(-2, 2, 32, -2, 4, 32))
+    EXPECT_TRUE(pass.empty());
+  EXPECT_EQ(model.some_result(), "not enough arguments");
+}
+
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
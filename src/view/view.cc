@@ -57,6 +57,17 @@ View::View(QWidget *parent) : QMainWindow(parent), ui_view(new Ui::View) {
   // connection of private graph slot with AC button for clean up the plot
   connect(ui_view->pushButton_ac, &QPushButton::clicked, this,
           &View::graph_slot);
+  // pan and zoom of the plot resample newly exposed part
+  ui_view->graph->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
+  connect(ui_view->graph->xAxis,
+          QOverload<const QCPRange &>::of(&QCPAxis::rangeChanged), this,
+          &View::range_slot);
+  connect(ui_view->graph->yAxis,
+          QOverload<const QCPRange &>::of(&QCPAxis::rangeChanged), this,
+          &View::range_slot);
+  // samples streamed by plotting thread are taken once per frame of screen
+  sampler.setInterval(16);
+  connect(&sampler, &QTimer::timeout, this, &View::samples_slot);
 }
 
 View::~View() { delete ui_view; }
@@ -71,36 +82,75 @@ void View::expression_slot() {
 }
 
 void View::graph_slot() {
-  double x_lo = ui_view->x_min->value();
-  double x_hi = ui_view->x_max->value();
-  double y_lo = ui_view->y_min->value();
-  double y_hi = ui_view->y_max->value();
-  ui_view->graph->xAxis->setRange(x_lo, x_hi);
-  ui_view->graph->yAxis->setRange(y_lo, y_hi);
-  int x_pix = ui_view->graph->xAxis->coordToPixel(1) -
-              ui_view->graph->xAxis->coordToPixel(0);
-  int y_pix = ui_view->graph->yAxis->coordToPixel(0) -
-              ui_view->graph->yAxis->coordToPixel(1);
-  graphs = controller->graph_content(x_lo, x_hi, x_pix, y_lo, y_hi, y_pix);
+  {
+    const QSignalBlocker x_blocker(ui_view->graph->xAxis);
+    const QSignalBlocker y_blocker(ui_view->graph->yAxis);
+    ui_view->graph->xAxis->setRange(ui_view->x_min->value(),
+                                    ui_view->x_max->value());
+    ui_view->graph->yAxis->setRange(ui_view->y_min->value(),
+                                    ui_view->y_max->value());
+  }
+  ui_view->graph->clearGraphs();
+  ui_view->graph->replot();
+  plot();
+}
+
+void View::range_slot() {
+  QCPRange x_range = ui_view->graph->xAxis->range();
+  QCPRange y_range = ui_view->graph->yAxis->range();
+  ui_view->x_min->setValue(x_range.lower);
+  ui_view->x_max->setValue(x_range.upper);
+  ui_view->y_min->setValue(y_range.lower);
+  ui_view->y_max->setValue(y_range.upper);
+  // drag changes both axes, they are plotted once per event loop pass
+  if (replot_pending) return;
+  replot_pending = true;
+  QTimer::singleShot(0, this, [this] {
+    replot_pending = false;
+    plot();
+  });
+}
+
+void View::plot() {
+  double x_lo = ui_view->graph->xAxis->range().lower;
+  double x_hi = ui_view->graph->xAxis->range().upper;
+  double y_lo = ui_view->graph->yAxis->range().lower;
+  double y_hi = ui_view->graph->yAxis->range().upper;
+  // pixels per unit from the size of the plot, fraction when the axis
+  // spans more units than pixels
+  double x_pix = ui_view->graph->axisRect()->width() / (x_hi - x_lo);
+  double y_pix = ui_view->graph->axisRect()->height() / (y_hi - y_lo);
+  controller->plot_graphs(x_lo, x_hi, x_pix, y_lo, y_hi, y_pix);
+  if (!sampler.isActive()) sampler.start();
   result = controller->result_content();
   setView();
 }
 
+void View::samples_slot() {
+  QCustomPlot *plot = ui_view->graph;
+  // finished plotting has written all its samples before they are taken
+  bool finished = !controller->plotting();
+  int taken = controller->take_samples(
+      [this, plot](quint64 frame, int graphs, int graph,
+                   const QVector<QCPGraphData> &data) {
+        if (frame != this->frame) {
+          this->frame = frame;
+          plot->clearGraphs();
+          for (int i = 0; i < graphs; i++) plot->addGraph();
+        }
+        if (graph < plot->graphCount())
+          plot->graph(graph)->data()->add(data, true);
+      });
+  if (taken) {
+    plot->replot();
+  } else if (finished) {
+    sampler.stop();
+  }
+}
+
 void View::setView() {
   ui_view->expres_label->setText(expression);
   ui_view->result_label->setText(result);
-
-  ui_view->graph->clearGraphs();
-  ui_view->graph->replot();
-  if (!graphs.empty()) {
-    for (int i = 0; i < graphs.size(); i++) {
-      ui_view->graph->addGraph();
-      QVector<double> x = QVector<double>::fromList(graphs[i].keys());
-      QVector<double> y = QVector<double>::fromList(graphs[i].values());
-      ui_view->graph->graph(i)->setData(x, y);
-    }
-    ui_view->graph->replot();
-  }
 }
 
 }  // namespace scn
@@ -7,7 +7,10 @@
 
 #include <QLabel>
 #include <QMainWindow>
+#include <QTimer>
+#include <functional>
 
+#include "qcustomplot.h"
 #include "ui_view.h"
 
 namespace scn {
@@ -31,6 +34,11 @@ QT_END_NAMESPACE
   contains Q_OBJECT macro, allowing use of signal-slot mechanism.
   By means of callback can call Controller method for data
   to be sent from View to Model for this data to be processed.
+  Graphs are plotted by Controller in the background and streamed as
+  blocks of samples, coarse graphs first and then the final ones, a timer
+  takes the blocks on GUI thread and appends them to the plot. New Plot
+  or AC cancels plotting in progress. Drag and zoom of the plot replot it
+  for the new ranges, keeping current graphs until the new ones come.
   DI ptr to Ui::View class implementation
 */
 class View : public QMainWindow {
@@ -65,13 +73,32 @@ class View : public QMainWindow {
     virtual void edit_variable(const QString &var_value) = 0;
 
     /*!
-      \return collection of graphs to represent graph expression
+      Receiver of block of samples of graph number graph out of graphs
+      of frame, block of new frame replaces graphs of previous one
     */
-    virtual QVector<QMap<double, double>> graph_content(double x_lo,
-                                                        double x_hi, int x_pix,
-                                                        double y_lo,
-                                                        double y_hi,
-                                                        int y_pix) = 0;
+    using PlotBlock =
+        std::function<void(quint64 frame, int graphs, int graph,
+                           const QVector<QCPGraphData> &data)>;
+
+    /*!
+      Starts plotting of graphs to represent graph expression in the
+      background, cancels plotting in progress, samples of coarse and
+      final graphs are streamed to take_samples
+    */
+    virtual void plot_graphs(double x_lo, double x_hi, double x_pix,
+                             double y_lo, double y_hi, double y_pix) = 0;
+
+    /*!
+      Takes samples streamed by plotting, called on GUI thread
+      \param[in] receiver receiver of blocks of samples
+      \return number of blocks taken
+    */
+    virtual int take_samples(const PlotBlock &receiver) = 0;
+
+    /*!
+      \return true while the last plotting may stream samples
+    */
+    virtual bool plotting() = 0;
   };
 
   View(QWidget *parent = nullptr);
@@ -85,13 +112,18 @@ class View : public QMainWindow {
  private slots:
   void expression_slot();
   void graph_slot();
+  void range_slot();
+  void samples_slot();
 
  private:
+  void plot();
   void setView();
   Ui::View *ui_view;
   QString expression;
   QString result;
-  QVector<QMap<double, double>> graphs;
+  QTimer sampler;  // runs from plotting until its last samples are taken
+  quint64 frame = ~0ull;
+  bool replot_pending = false;
 };
 
 }  // namespace scn